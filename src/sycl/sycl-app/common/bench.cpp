@@ -0,0 +1,380 @@
+#include "common/bench.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+/* Samples shorter than this are made of several calls */
+#define BENCH_MIN_SAMPLE_NS 20000.0
+
+/* Fewest samples for which each tail percentile is reported */
+#define BENCH_P95_MIN_SAMPLES 20
+#define BENCH_P99_MIN_SAMPLES 100
+
+/* Bytes streamed to flush the caches, larger than any LLC we run on */
+#define BENCH_FLUSH_BYTES (64 << 20)
+
+static void print_usage(const char *name) {
+    std::cerr << "Usage: " << name << " [options]" << std::endl
+              << "  --algo a,b,...    only run these algorithms" << std::endl
+              << "  --device d,...    only use these devices (gpu, cpu)" << std::endl
+              << "  --size n,...      only run these sizes" << std::endl
+              << "  --warmup n        untimed samples before timing" << std::endl
+              << "  --repeat n        timed samples per measurement" << std::endl
+              << "  --cold            flush caches before every sample" << std::endl
+              << "  --verify          check results instead of timing" << std::endl
+              << "  --json file       write results as JSON" << std::endl
+              << "  --csv file        write results as CSV" << std::endl
+              << "  --help            show this text" << std::endl;
+}
+
+static std::vector<std::string> split_list(const std::string &list) {
+    std::vector<std::string> items;
+    std::istringstream stream(list);
+    std::string item;
+    while (std::getline(stream, item, ',')) {
+        if (!item.empty()) {
+            items.push_back(item);
+        }
+    }
+    return items;
+}
+
+static int parse_count(const char *text, size_t &value) {
+    char *end;
+    auto parsed = std::strtoull(text, &end, 0);
+    if ((end == text) || *end) {
+        return -1;
+    }
+    value = parsed;
+    return 0;
+}
+
+int bench_parse_args(int argc, char **argv, BenchOptions &opts) {
+    for (auto i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+
+        if ((arg == "--help") || (arg == "-h")) {
+            print_usage(argv[0]);
+            return 1;
+        }
+        if (arg == "--cold") {
+            opts.cold = true;
+            continue;
+        }
+        if (arg == "--verify") {
+            opts.verify = true;
+            continue;
+        }
+
+        static const char *with_value[] = {"--algo", "--device", "--size", "--warmup", "--repeat", "--json", "--csv"};
+        if (std::find(std::begin(with_value), std::end(with_value), arg) == std::end(with_value)) {
+            std::cerr << "Unknown option " << arg << std::endl;
+            print_usage(argv[0]);
+            return -1;
+        }
+        if (i + 1 >= argc) {
+            std::cerr << "Missing value for " << arg << std::endl;
+            print_usage(argv[0]);
+            return -1;
+        }
+        const char *value = argv[++i];
+
+        int res = 0;
+        if (arg == "--algo") {
+            opts.algos = split_list(value);
+        } else if (arg == "--device") {
+            opts.devices = split_list(value);
+        } else if (arg == "--size") {
+            opts.sizes.clear();
+            for (auto &item : split_list(value)) {
+                size_t size;
+                res |= parse_count(item.c_str(), size);
+                opts.sizes.push_back(size);
+            }
+        } else if (arg == "--warmup") {
+            res = parse_count(value, opts.warmup);
+        } else if (arg == "--repeat") {
+            res = parse_count(value, opts.repeat);
+            if (opts.repeat == 0) {
+                res = -1;
+            }
+        } else if (arg == "--json") {
+            opts.json_path = value;
+        } else {
+            opts.csv_path = value;
+        }
+
+        if (res) {
+            std::cerr << "Bad argument " << arg << " " << value << std::endl;
+            print_usage(argv[0]);
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+static bool in_list(const std::vector<std::string> &list, const std::string &name) {
+    return list.empty() || (std::find(list.begin(), list.end(), name) != list.end());
+}
+
+bool bench_algo_selected(const BenchOptions &opts, const std::string &algo) {
+    return in_list(opts.algos, algo);
+}
+
+bool bench_device_selected(const BenchOptions &opts, const std::string &device) {
+    return in_list(opts.devices, device);
+}
+
+std::vector<size_t> bench_sizes(const BenchOptions &opts, const std::vector<size_t> &sizes) {
+    return opts.sizes.empty() ? sizes : opts.sizes;
+}
+
+std::vector<size_t> bench_sizes_in(const BenchOptions &opts, const std::vector<size_t> &range) {
+    std::vector<size_t> kept;
+    for (auto size : range) {
+        if (opts.sizes.empty() || (std::find(opts.sizes.begin(), opts.sizes.end(), size) != opts.sizes.end())) {
+            kept.push_back(size);
+        }
+    }
+    return kept;
+}
+
+void bench_flush_caches() {
+    static std::vector<char> buffer(BENCH_FLUSH_BYTES);
+    static unsigned pass = 0;
+
+    /* Write then read every line so both clean and dirty lines are evicted */
+    pass++;
+    for (size_t i = 0; i < buffer.size(); i += 64) {
+        buffer[i] = (char)(i + pass);
+    }
+    volatile char sink = 0;
+    for (size_t i = 0; i < buffer.size(); i += 64) {
+        sink = sink + buffer[i];
+    }
+}
+
+/* Nearest-rank percentile of sorted samples */
+static double percentile(const std::vector<double> &sorted, double p) {
+    auto rank = (size_t)std::ceil(p / 100.0 * (double)sorted.size());
+    return sorted[std::min(sorted.size(), std::max<size_t>(rank, 1)) - 1];
+}
+
+BenchStats bench_measure(const BenchOptions &opts, const std::function<double()> &sample) {
+    BenchStats stats;
+
+    for (size_t i = 0; i < opts.warmup; i++) {
+        if (opts.cold) {
+            bench_flush_caches();
+        }
+        if (sample() < 0) {
+            return stats;
+        }
+    }
+
+    std::vector<double> times;
+    times.reserve(opts.repeat);
+    for (size_t i = 0; i < opts.repeat; i++) {
+        if (opts.cold) {
+            bench_flush_caches();
+        }
+        auto t = sample();
+        if (t < 0) {
+            return stats;
+        }
+        times.push_back(t);
+    }
+
+    std::sort(times.begin(), times.end());
+    double sum = 0;
+    for (auto t : times) {
+        sum += t;
+    }
+
+    stats.ok = true;
+    stats.samples = times.size();
+    stats.min = times.front();
+    stats.max = times.back();
+    stats.mean = sum / (double)times.size();
+    stats.median = percentile(times, 50);
+    stats.p95 = (times.size() >= BENCH_P95_MIN_SAMPLES) ? percentile(times, 95) : NAN;
+    stats.p99 = (times.size() >= BENCH_P99_MIN_SAMPLES) ? percentile(times, 99) : NAN;
+
+    return stats;
+}
+
+BenchStats bench_measure_calls(const BenchOptions &opts, const std::function<int()> &fn) {
+    size_t inner = 1;
+
+    /* Size the samples from one untimed call */
+    auto start = std::chrono::high_resolution_clock::now();
+    if (fn()) {
+        return BenchStats();
+    }
+    auto end = std::chrono::high_resolution_clock::now();
+    double once = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+    if (!opts.cold && (once < BENCH_MIN_SAMPLE_NS)) {
+        inner = (size_t)std::ceil(BENCH_MIN_SAMPLE_NS / std::max(once, 1.0));
+    }
+
+    return bench_measure(opts, [&]() -> double {
+        auto start = std::chrono::high_resolution_clock::now();
+        for (size_t i = 0; i < inner; i++) {
+            if (fn()) {
+                return -1;
+            }
+        }
+        auto end = std::chrono::high_resolution_clock::now();
+        return (double)std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count() / (double)inner;
+    });
+}
+
+BenchReport::BenchReport(const std::string &demo, const BenchOptions &opts) :
+demo(demo), opts(opts) {
+}
+
+void BenchReport::add(const std::string &algo, const std::string &device, size_t size,
+                      const BenchStats &stats, double flops, double bytes) {
+    this->results.push_back({algo, device, size, stats, flops, bytes});
+}
+
+static std::string json_string(const std::string &text) {
+    std::string out = "\"";
+    for (auto c : text) {
+        switch (c) {
+        case '"': out += "\\\""; break;
+        case '\\': out += "\\\\"; break;
+        case '\b': out += "\\b"; break;
+        case '\f': out += "\\f"; break;
+        case '\n': out += "\\n"; break;
+        case '\r': out += "\\r"; break;
+        case '\t': out += "\\t"; break;
+        default:
+            if ((unsigned char)c < 0x20) {
+                char escaped[8];
+                std::snprintf(escaped, sizeof(escaped), "\\u%04x", (unsigned)c);
+                out += escaped;
+            } else {
+                out += c;
+            }
+        }
+    }
+    return out + "\"";
+}
+
+/* Percentiles without enough samples are null */
+static std::string json_number(double value) {
+    if (std::isnan(value)) {
+        return "null";
+    }
+    std::ostringstream out;
+    out << value;
+    return out.str();
+}
+
+/* Fields holding separators, quotes or line breaks are quoted, with quotes
+ * doubled, as in RFC 4180 */
+static std::string csv_field(const std::string &text) {
+    if (text.find_first_of(",\"\r\n") == std::string::npos) {
+        return text;
+    }
+    std::string out = "\"";
+    for (auto c : text) {
+        if (c == '"') {
+            out += '"';
+        }
+        out += c;
+    }
+    return out + "\"";
+}
+
+/* Percentiles without enough samples are empty */
+static std::string csv_number(double value) {
+    return std::isnan(value) ? "" : json_number(value);
+}
+
+/* Derived rates at the median time */
+static double gflops(const BenchResult &r) {
+    return (r.stats.ok && r.stats.median > 0) ? r.flops / r.stats.median : 0;
+}
+
+static double gbytes(const BenchResult &r) {
+    return (r.stats.ok && r.stats.median > 0) ? r.bytes / r.stats.median : 0;
+}
+
+int BenchReport::write_json(const std::string &path) {
+    std::ofstream file(path, std::ios::trunc);
+    if (!file) {
+        return -1;
+    }
+
+    file << "{" << std::endl
+         << "  \"demo\": " << json_string(this->demo) << "," << std::endl
+         << "  \"warmup\": " << this->opts.warmup << "," << std::endl
+         << "  \"repeat\": " << this->opts.repeat << "," << std::endl
+         << "  \"cold_cache\": " << (this->opts.cold ? "true" : "false") << "," << std::endl
+         << "  \"results\": [" << std::endl;
+
+    for (size_t i = 0; i < this->results.size(); i++) {
+        auto &r = this->results[i];
+        file << "    {\"algo\": " << json_string(r.algo)
+             << ", \"device\": " << json_string(r.device)
+             << ", \"size\": " << r.size
+             << ", \"ok\": " << (r.stats.ok ? "true" : "false")
+             << ", \"samples\": " << r.stats.samples
+             << ", \"min_ns\": " << r.stats.min
+             << ", \"mean_ns\": " << r.stats.mean
+             << ", \"median_ns\": " << r.stats.median
+             << ", \"p95_ns\": " << json_number(r.stats.p95)
+             << ", \"p99_ns\": " << json_number(r.stats.p99)
+             << ", \"max_ns\": " << r.stats.max
+             << ", \"gflops\": " << gflops(r)
+             << ", \"gbytes_per_s\": " << gbytes(r) << "}"
+             << ((i + 1 < this->results.size()) ? "," : "") << std::endl;
+    }
+
+    file << "  ]" << std::endl << "}" << std::endl;
+
+    return file ? 0 : -1;
+}
+
+int BenchReport::write_csv(const std::string &path) {
+    std::ofstream file(path, std::ios::trunc);
+    if (!file) {
+        return -1;
+    }
+
+    file << "demo,algo,device,size,ok,samples,min_ns,mean_ns,median_ns,p95_ns,p99_ns,max_ns,gflops,gbytes_per_s,cold_cache" << std::endl;
+    for (auto &r : this->results) {
+        file << csv_field(this->demo) << "," << csv_field(r.algo) << "," << csv_field(r.device) << "," << r.size << ","
+             << (r.stats.ok ? 1 : 0) << "," << r.stats.samples << ","
+             << r.stats.min << "," << r.stats.mean << "," << r.stats.median << ","
+             << csv_number(r.stats.p95) << "," << csv_number(r.stats.p99) << "," << r.stats.max << ","
+             << gflops(r) << "," << gbytes(r) << "," << (this->opts.cold ? 1 : 0) << std::endl;
+    }
+
+    return file ? 0 : -1;
+}
+
+int BenchReport::write() {
+    int res = 0;
+
+    if (!this->opts.json_path.empty() && this->write_json(this->opts.json_path)) {
+        std::cerr << "Failed to write " << this->opts.json_path << std::endl;
+        res = -1;
+    }
+    if (!this->opts.csv_path.empty() && this->write_csv(this->opts.csv_path)) {
+        std::cerr << "Failed to write " << this->opts.csv_path << std::endl;
+        res = -1;
+    }
+
+    return res;
+}
@@ -0,0 +1,108 @@
+#ifndef BENCH_HPP
+#define BENCH_HPP
+
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <vector>
+
+/*
+ * Shared benchmark harness
+ *
+ * Every measurement runs some untimed warm-up samples and then a number of
+ * timed samples, and reports their distribution rather than one mean. In
+ * cold-cache mode the caches are flushed before each sample. Results are
+ * collected in a BenchReport, which can write them as JSON and/or CSV next to
+ * the demos' usual tables so runs can be compared across builds.
+ */
+
+struct BenchOptions {
+    size_t warmup = 2;
+    size_t repeat = 20;
+    bool cold = false;
+
+    /* Check results against a reference instead of timing, in demos that
+     * support it. Failures make the demo exit non-zero */
+    bool verify = false;
+
+    /* Selections, empty means everything the demo offers */
+    std::vector<std::string> algos;
+    std::vector<std::string> devices;
+    std::vector<size_t> sizes;
+
+    std::string json_path;
+    std::string csv_path;
+};
+
+/* Parse the common command line options into `opts`, which holds the
+ * demo's defaults. Returns 0 to go on, 1 if only help was asked for and -1
+ * on bad arguments, after printing the usage to stderr */
+int bench_parse_args(int argc, char **argv, BenchOptions &opts);
+
+bool bench_algo_selected(const BenchOptions &opts, const std::string &algo);
+bool bench_device_selected(const BenchOptions &opts, const std::string &device);
+
+/* Sizes to run: the --size list if one was given, else the demo's `sizes` */
+std::vector<size_t> bench_sizes(const BenchOptions &opts, const std::vector<size_t> &sizes);
+
+/* Sizes of a table's fixed `range` that the --size list keeps, all of them
+ * without one */
+std::vector<size_t> bench_sizes_in(const BenchOptions &opts, const std::vector<size_t> &range);
+
+/* Evict the data caches by streaming over a buffer larger than the LLC */
+void bench_flush_caches();
+
+/* Per-call times in nanoseconds. A percentile needs enough samples for its
+ * rank to sit below the maximum, p95 at least 20 and p99 at least 100; with
+ * fewer it is NaN and left out of the reports */
+struct BenchStats {
+    bool ok = false;
+    size_t samples = 0;
+    double min = 0;
+    double mean = 0;
+    double median = 0;
+    double p95 = 0;
+    double p99 = 0;
+    double max = 0;
+};
+
+/* One sample runs the work and returns its time per call in nanoseconds, or a
+ * negative value on failure. Used where the work times itself, such as
+ * kernels timed without their transfers */
+BenchStats bench_measure(const BenchOptions &opts, const std::function<double()> &sample);
+
+/* Wall-clock timing of `fn`, which returns 0 on success. Short calls are
+ * repeated within a sample so each sample is long enough to time reliably,
+ * except in cold-cache mode */
+BenchStats bench_measure_calls(const BenchOptions &opts, const std::function<int()> &fn);
+
+struct BenchResult {
+    std::string algo;
+    std::string device;
+    size_t size;
+    BenchStats stats;
+    /* Work per call, for the derived GFLOP/s and GB/s */
+    double flops;
+    double bytes;
+};
+
+class BenchReport {
+private:
+    std::string demo;
+    const BenchOptions &opts;
+    std::vector<BenchResult> results;
+
+    int write_json(const std::string &path);
+    int write_csv(const std::string &path);
+
+public:
+    BenchReport(const std::string &demo, const BenchOptions &opts);
+
+    void add(const std::string &algo, const std::string &device, size_t size,
+             const BenchStats &stats, double flops, double bytes);
+
+    /* Write the requested machine-readable outputs, -1 if any failed */
+    int write();
+};
+
+#endif
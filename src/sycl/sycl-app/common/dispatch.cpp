@@ -0,0 +1,124 @@
+#include "common/dispatch.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+
+/* Empty kernel round trips timed per device */
+#define DISPATCH_LAUNCH_SAMPLES 32
+
+/* Each path is timed this many times per size, the fastest counts */
+#define DISPATCH_SAMPLES 3
+
+/* Consecutive sizes the device has to win to end calibration */
+#define DISPATCH_CONFIRM 2
+
+/* Calibration stops past sizes where the host path takes this long */
+#define DISPATCH_MAX_NS 1e7
+
+size_t SyclDispatch::add_device(sycl::queue &q, const std::string &name) {
+    BenchOptions opts;
+    opts.warmup = 2;
+    opts.repeat = DISPATCH_LAUNCH_SAMPLES;
+
+    auto launch = bench_measure(opts, [&]() -> double {
+        try {
+            auto start = std::chrono::high_resolution_clock::now();
+
+            q.submit([&](sycl::handler &cgh) {
+                cgh.single_task([=]() {});
+            }).wait();
+
+            auto end = std::chrono::high_resolution_clock::now();
+            return (double)std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+        } catch (const sycl::exception &e) {
+            std::cerr << "Exception caught: " << e.what() << std::endl;
+            return -1;
+        }
+    });
+
+    this->devices.push_back({name, launch});
+    return this->devices.size() - 1;
+}
+
+/* Fastest of DISPATCH_SAMPLES runs, negative if any failed */
+static double best_of(const SyclDispatch::path_t &path, size_t size) {
+    double best = -1;
+    for (auto i = 0; i < DISPATCH_SAMPLES; i++) {
+        auto ns = path(size);
+        if (ns < 0) {
+            return -1;
+        }
+        best = (best < 0) ? ns : std::min(best, ns);
+    }
+    return best;
+}
+
+size_t SyclDispatch::calibrate(const std::string &op, size_t device, const std::vector<size_t> &sizes,
+                               const path_t &host, const path_t &dev) {
+    size_t first_win = NEVER;
+    size_t wins = 0;
+    size_t last = 0;
+
+    for (auto size : sizes) {
+        auto host_ns = best_of(host, size);
+        auto dev_ns = best_of(dev, size);
+        if ((host_ns < 0) && (dev_ns < 0)) {
+            continue;
+        }
+        last = size;
+
+        if ((dev_ns >= 0) && ((host_ns < 0) || (dev_ns < host_ns))) {
+            if (!wins) {
+                first_win = size;
+            }
+            if (++wins >= DISPATCH_CONFIRM) {
+                break;
+            }
+        } else {
+            wins = 0;
+            first_win = NEVER;
+        }
+
+        if (host_ns > DISPATCH_MAX_NS) {
+            break;
+        }
+    }
+
+    this->ops.push_back({op, device, first_win, last, false});
+    return this->ops.size() - 1;
+}
+
+size_t SyclDispatch::fixed(const std::string &op, size_t device, size_t crossover) {
+    this->ops.push_back({op, device, crossover, 0, true});
+    return this->ops.size() - 1;
+}
+
+void SyclDispatch::print(std::ostream &out) const {
+    out << "# dispatch, launch overhead in nanoseconds at the median and the size from which each"
+        << " operation runs on the device" << std::endl;
+    out << "device, launch overhead, operation, crossover, calibrated up to" << std::endl;
+    for (auto &dev : this->devices) {
+        auto listed = false;
+        for (auto &op : this->ops) {
+            if (&this->devices[op.device] != &dev) {
+                continue;
+            }
+            out << dev.name << ", " << (dev.launch.ok ? dev.launch.median : -1) << ", " << op.name << ", ";
+            if (op.crossover == NEVER) {
+                out << "never";
+            } else {
+                out << op.crossover;
+            }
+            if (op.fixed) {
+                out << ", fixed" << std::endl;
+            } else {
+                out << ", " << op.calibrated_to << std::endl;
+            }
+            listed = true;
+        }
+        if (!listed) {
+            out << dev.name << ", " << (dev.launch.ok ? dev.launch.median : -1) << ", -, -, -" << std::endl;
+        }
+    }
+}
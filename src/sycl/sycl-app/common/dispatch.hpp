@@ -0,0 +1,85 @@
+#ifndef DISPATCH_HPP
+#define DISPATCH_HPP
+
+#include <cstddef>
+#include <functional>
+#include <ostream>
+#include <string>
+#include <sycl/sycl.hpp>
+#include <vector>
+
+#include "common/bench.hpp"
+
+/*
+ * Size-based host/device dispatch
+ *
+ * Every launch on a SYCL device pays a fixed cost, microseconds to tens of
+ * microseconds, that dwarfs small problems the host finishes inline in
+ * nanoseconds. Each device's launch overhead is measured when it is added, as
+ * the round trip of an empty kernel. Operations are then calibrated per
+ * device: the host and device paths are timed at increasing sizes, and the
+ * crossover is the first size from which the device path stays faster. Below
+ * the crossover the caller runs the host path, from it on the device.
+ *
+ * Calibration stops once the device has won DISPATCH_CONFIRM sizes in a row,
+ * or once the host path takes longer than DISPATCH_MAX_NS, where launch
+ * overhead no longer matters. An operation whose device path never won stays
+ * on the host.
+ */
+class SyclDispatch {
+public:
+    /* Time one operation of `size` on a path in nanoseconds, or a negative
+     * value on failure */
+    typedef std::function<double(size_t size)> path_t;
+
+    /* Crossover of an operation that always runs on the host */
+    static const size_t NEVER = (size_t)-1;
+
+private:
+    struct Device {
+        std::string name;
+        BenchStats launch;
+    };
+
+    struct Op {
+        std::string name;
+        size_t device;
+        size_t crossover;
+        /* Largest size timed during calibration */
+        size_t calibrated_to;
+        /* Set with fixed() rather than calibrated */
+        bool fixed;
+    };
+
+    std::vector<Device> devices;
+    std::vector<Op> ops;
+
+public:
+    /* Measure the launch overhead of `q` and add it, returns its index */
+    size_t add_device(sycl::queue &q, const std::string &name);
+
+    const std::string &device_name(size_t device) const { return this->devices[device].name; }
+
+    /* Distribution of the empty kernel round trip in nanoseconds */
+    const BenchStats &launch_overhead(size_t device) const { return this->devices[device].launch; }
+
+    /* Find the crossover of `op` on `device` over ascending `sizes`, returns
+     * a handle for on_device() */
+    size_t calibrate(const std::string &op, size_t device, const std::vector<size_t> &sizes,
+                     const path_t &host, const path_t &dev);
+
+    /* Add `op` on `device` with a given crossover instead of a calibrated
+     * one, NEVER keeps it on the host and 0 always runs it on the device.
+     * Returns a handle for on_device() */
+    size_t fixed(const std::string &op, size_t device, size_t crossover);
+
+    /* Whether operation `handle` should run at `size` on its device */
+    bool on_device(size_t handle, size_t size) const { return size >= this->ops[handle].crossover; }
+
+    size_t crossover(size_t handle) const { return this->ops[handle].crossover; }
+
+    /* Launch overhead of every device and crossover of every operation */
+    void print(std::ostream &out) const;
+};
+
+#endif
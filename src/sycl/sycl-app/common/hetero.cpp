@@ -0,0 +1,207 @@
+#include "common/hetero.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <sstream>
+
+/* Weight of the newest measurement in the smoothed rate */
+#define HETERO_SMOOTHING 0.5
+
+/* Smallest share of the work a queue is given, so it stays measured */
+#define HETERO_MIN_SHARE 0.02
+
+HeteroScheduler::HeteroScheduler(size_t granule) {
+    this->granule = std::max<size_t>(1, granule);
+}
+
+HeteroScheduler::~HeteroScheduler() {
+    {
+        std::lock_guard<std::mutex> guard(this->lock);
+        this->stop = true;
+    }
+    this->wake.notify_all();
+
+    for (auto &t : this->drivers) {
+        t.join();
+    }
+}
+
+void HeteroScheduler::add(const sycl::queue &q, const std::string &name) {
+    this->queues.push_back(q);
+    this->names.push_back(name);
+    this->rates.push_back(0);
+
+    if (this->queues.size() > 1) {
+        std::lock_guard<std::mutex> guard(this->lock);
+        this->drivers.emplace_back(&HeteroScheduler::driver_main, this, this->queues.size() - 1, this->generation);
+    }
+}
+
+void HeteroScheduler::driver_main(size_t part, size_t seen) {
+    std::unique_lock<std::mutex> guard(this->lock);
+    while (true) {
+        this->wake.wait(guard, [&] { return this->stop || (this->generation != seen); });
+        if (this->stop) {
+            return;
+        }
+        seen = this->generation;
+        auto job = this->job;
+
+        guard.unlock();
+        (*job)(part);
+        guard.lock();
+
+        if (--this->outstanding == 0) {
+            this->done.notify_one();
+        }
+    }
+}
+
+std::vector<std::pair<size_t, size_t>> HeteroScheduler::partition(size_t units) const {
+    auto n = this->queues.size();
+    std::vector<std::pair<size_t, size_t>> parts(n, {units, units});
+    if (n == 0) {
+        return parts;
+    }
+
+    /* Unmeasured queues are assumed as fast as the fastest measured one, or
+     * all equal before anything has run */
+    auto fastest = *std::max_element(this->rates.begin(), this->rates.end());
+    std::vector<double> shares(n);
+    double total = 0;
+    for (size_t i = 0; i < n; i++) {
+        shares[i] = (this->rates[i] > 0) ? this->rates[i] : ((fastest > 0) ? fastest : 1);
+        total += shares[i];
+    }
+    double clamped = 0;
+    for (size_t i = 0; i < n; i++) {
+        shares[i] = std::max(shares[i] / total, HETERO_MIN_SHARE);
+        clamped += shares[i];
+    }
+
+    size_t begin = 0;
+    double cumulative = 0;
+    for (size_t i = 0; i < n; i++) {
+        cumulative += shares[i] / clamped;
+        size_t end = units;
+        if (i + 1 < n) {
+            end = (size_t)(cumulative * units + 0.5);
+            end = std::min(units, (end + this->granule / 2) / this->granule * this->granule);
+            end = std::max(end, begin);
+        }
+        parts[i] = {begin, end};
+        begin = end;
+    }
+
+    return parts;
+}
+
+double HeteroScheduler::run(size_t units, const work_t &work) {
+    typedef std::chrono::high_resolution_clock clock;
+
+    auto parts = this->partition(units);
+    auto n = parts.size();
+    std::vector<clock::time_point> starts(n);
+    std::vector<clock::time_point> stops(n);
+    std::vector<int> results(n, 0);
+
+    std::function<void(size_t)> run_part = [&](size_t i) {
+        auto begin = parts[i].first;
+        auto end = parts[i].second;
+        if (begin == end) {
+            return;
+        }
+        starts[i] = clock::now();
+        results[i] = work(this->queues[i], begin, end);
+        stops[i] = clock::now();
+    };
+
+    /* Hand parts 1.. to the drivers and run part 0 here */
+    if (n > 1) {
+        {
+            std::lock_guard<std::mutex> guard(this->lock);
+            this->job = &run_part;
+            this->outstanding = n - 1;
+            this->generation++;
+        }
+        this->wake.notify_all();
+    }
+    if (n) {
+        run_part(0);
+    }
+    if (n > 1) {
+        std::unique_lock<std::mutex> guard(this->lock);
+        this->done.wait(guard, [this] { return this->outstanding == 0; });
+        this->job = nullptr;
+    }
+
+    for (size_t i = 0; i < n; i++) {
+        if (results[i]) {
+            return -1;
+        }
+    }
+
+    /* Wall time from the first part starting to the last finishing, so
+     * handing parts to the drivers is not counted */
+    auto first = clock::time_point::max();
+    auto last = clock::time_point::min();
+    for (size_t i = 0; i < n; i++) {
+        auto count = parts[i].second - parts[i].first;
+        if (!count) {
+            continue;
+        }
+        first = std::min(first, starts[i]);
+        last = std::max(last, stops[i]);
+
+        auto time = (double)std::chrono::duration_cast<std::chrono::nanoseconds>(stops[i] - starts[i]).count();
+        if (time <= 0) {
+            continue;
+        }
+        auto rate = (double)count / time;
+        this->rates[i] = (this->rates[i] > 0)
+            ? (1 - HETERO_SMOOTHING) * this->rates[i] + HETERO_SMOOTHING * rate
+            : rate;
+    }
+    if (first > last) {
+        return 0;
+    }
+
+    return (double)std::chrono::duration_cast<std::chrono::nanoseconds>(last - first).count();
+}
+
+std::string HeteroScheduler::shares() const {
+    /* Shares of a large split, so granule rounding does not show */
+    auto units = this->granule * 10000;
+    auto parts = this->partition(units);
+
+    std::ostringstream out;
+    out.precision(2);
+    for (size_t i = 0; i < parts.size(); i++) {
+        if (i) {
+            out << ", ";
+        }
+        out << this->names[i] << " " << (double)(parts[i].second - parts[i].first) / (double)units;
+    }
+    return out.str();
+}
+
+std::vector<sycl::queue> hetero_cpu_queues(const sycl::device &cpu) {
+    std::vector<sycl::queue> queues;
+    try {
+        if (cpu.get_info<sycl::info::device::partition_max_sub_devices>() > 1) {
+            auto subs = cpu.create_sub_devices<sycl::info::partition_property::partition_by_affinity_domain>(
+                sycl::info::partition_affinity_domain::numa);
+            for (auto &sub : subs) {
+                queues.push_back(sycl::queue{sub});
+            }
+        }
+    } catch (const sycl::exception &e) {
+        /* Not partitionable by NUMA domain, use the whole device */
+        queues.clear();
+    }
+
+    if (queues.empty()) {
+        queues.push_back(sycl::queue{cpu});
+    }
+    return queues;
+}
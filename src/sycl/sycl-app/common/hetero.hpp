@@ -0,0 +1,82 @@
+#ifndef HETERO_HPP
+#define HETERO_HPP
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <sycl/sycl.hpp>
+#include <thread>
+#include <vector>
+
+/*
+ * Proportional heterogeneous scheduler
+ *
+ * Splits one operation of `units` independent work units (output rows of a
+ * GEMM, elements of a vector operation) across several queues. Each queue's
+ * share is proportional to the throughput it last achieved, in units per
+ * nanosecond including its transfers, smoothed over calls so the split
+ * settles where all devices finish together and follows changes in load.
+ * Every queue keeps a small minimum share so its throughput is still measured
+ * after it falls behind.
+ *
+ * The work itself is a callback that handles the range [begin, end) on one
+ * queue and waits for it. Callbacks for different queues run concurrently and
+ * write disjoint parts of the same result, nothing is duplicated. The caller
+ * drives the first queue and a persistent driver thread each of the others,
+ * created by add(), so a run starts no threads.
+ */
+class HeteroScheduler {
+public:
+    /* Process units [begin, end) on `q` and wait for completion, 0 on success */
+    typedef std::function<int(sycl::queue &q, size_t begin, size_t end)> work_t;
+
+private:
+    std::vector<sycl::queue> queues;
+    std::vector<std::string> names;
+    /* Units per nanosecond, 0 until first measured */
+    std::vector<double> rates;
+    size_t granule;
+
+    /* Driver i - 1 runs part i of the current job, `generation` counts jobs */
+    std::vector<std::thread> drivers;
+    std::mutex lock;
+    std::condition_variable wake;
+    std::condition_variable done;
+    const std::function<void(size_t)> *job = nullptr;
+    size_t generation = 0;
+    size_t outstanding = 0;
+    bool stop = false;
+
+    void driver_main(size_t part, size_t seen);
+
+public:
+    /* Shares are multiples of `granule` units, apart from the last one */
+    HeteroScheduler(size_t granule = 1);
+    ~HeteroScheduler();
+
+    HeteroScheduler(const HeteroScheduler &) = delete;
+    HeteroScheduler &operator=(const HeteroScheduler &) = delete;
+
+    void add(const sycl::queue &q, const std::string &name);
+    size_t size() const { return this->queues.size(); }
+
+    /* Split [0, units) into one [begin, end) range per queue */
+    std::vector<std::pair<size_t, size_t>> partition(size_t units) const;
+
+    /* Run `work` over [0, units) split across all queues, returning the wall
+     * time in nanoseconds from the first part starting to the last finishing,
+     * or -1 if any part failed */
+    double run(size_t units, const work_t &work);
+
+    /* Current fraction of the work per queue, e.g. "gpu 0.81, cpu 0.19" */
+    std::string shares() const;
+};
+
+/* Queues for the NUMA domains of a CPU device, or one queue for the whole
+ * device where it cannot be partitioned */
+std::vector<sycl::queue> hetero_cpu_queues(const sycl::device &cpu);
+
+#endif
@@ -0,0 +1,98 @@
+#include "common/pipeline.hpp"
+
+#include <chrono>
+#include <iostream>
+
+SyclPipeline::SyclPipeline(sycl::queue &queue, const std::vector<size_t> &in_bytes, const std::vector<size_t> &out_bytes)
+    : queue(queue), in_bytes(in_bytes), out_bytes(out_bytes) {
+    for (auto slot = 0; slot < 2; slot++) {
+        for (auto bytes : in_bytes) {
+            this->in_dev[slot].push_back(sycl::malloc_device(bytes, queue));
+        }
+        for (auto bytes : out_bytes) {
+            this->out_dev[slot].push_back(sycl::malloc_device(bytes, queue));
+        }
+    }
+}
+
+SyclPipeline::~SyclPipeline() {
+    for (auto slot = 0; slot < 2; slot++) {
+        for (auto ptr : this->in_dev[slot]) {
+            if (ptr) {
+                sycl::free(ptr, this->queue);
+            }
+        }
+        for (auto ptr : this->out_dev[slot]) {
+            if (ptr) {
+                sycl::free(ptr, this->queue);
+            }
+        }
+    }
+}
+
+double SyclPipeline::run(size_t runs, const void *const *host_in, void *const *host_out, const kernel_t &kernel) {
+    for (auto slot = 0; slot < 2; slot++) {
+        for (auto ptr : this->in_dev[slot]) {
+            if (!ptr) {
+                return -1;
+            }
+        }
+        for (auto ptr : this->out_dev[slot]) {
+            if (!ptr) {
+                return -1;
+            }
+        }
+    }
+
+    unsigned long runtime = 0;
+
+    try {
+        /* Last kernel and last copy-out per slot */
+        std::vector<sycl::event> computed[2];
+        std::vector<sycl::event> copied_out[2];
+        std::vector<sycl::event> all;
+
+        auto start = std::chrono::high_resolution_clock::now();
+
+        for (size_t run = 0; run < runs; run++) {
+            auto slot = run % 2;
+
+            /* Inputs of this slot were last read by the kernel two
+             * iterations ago */
+            std::vector<sycl::event> kernel_deps;
+            for (size_t i = 0; i < this->in_bytes.size(); i++) {
+                kernel_deps.push_back(this->queue.memcpy(this->in_dev[slot][i], host_in[i],
+                                                         this->in_bytes[i], computed[slot]));
+            }
+
+            /* Its outputs must have been copied out before they are
+             * overwritten */
+            kernel_deps.insert(kernel_deps.end(), copied_out[slot].begin(), copied_out[slot].end());
+            auto done = kernel(this->queue, kernel_deps, this->in_dev[slot].data(), this->out_dev[slot].data());
+            computed[slot] = {done};
+
+            /* Copy-outs to the same host memory stay in iteration order */
+            auto out_deps = computed[slot];
+            auto other = copied_out[slot ^ 1];
+            out_deps.insert(out_deps.end(), other.begin(), other.end());
+            copied_out[slot].clear();
+            for (size_t i = 0; i < this->out_bytes.size(); i++) {
+                copied_out[slot].push_back(this->queue.memcpy(host_out[i], this->out_dev[slot][i],
+                                                              this->out_bytes[i], out_deps));
+            }
+            all.insert(all.end(), copied_out[slot].begin(), copied_out[slot].end());
+        }
+
+        sycl::event::wait(all);
+
+        auto end = std::chrono::high_resolution_clock::now();
+        runtime = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+
+        this->queue.throw_asynchronous();
+    } catch (const sycl::exception &e) {
+        std::cerr << "Exception caught: " << e.what() << std::endl;
+        return -1;
+    }
+
+    return (double)runtime;
+}
@@ -0,0 +1,53 @@
+#ifndef PIPELINE_HPP
+#define PIPELINE_HPP
+
+#include <cstddef>
+#include <functional>
+#include <sycl/sycl.hpp>
+#include <vector>
+
+/*
+ * Pipelined SYCL submission
+ *
+ * Runs an operation several times back to back as copy-in, kernel, copy-out
+ * per iteration, all enqueued up front with explicit event dependencies and a
+ * single wait at the end. Device inputs and outputs are double-buffered: while
+ * the kernel of iteration N runs from one slot, the inputs of iteration N+1
+ * are copied into the other, and the results of N-1 are copied out. A slot is
+ * only overwritten once the kernel that read it, and the copy-out of its
+ * previous result, have finished.
+ *
+ * The total time over the iterations is sustained throughput. A single
+ * iteration gives the latency of one operation including its transfers.
+ */
+class SyclPipeline {
+public:
+    /* Enqueue the operation reading `in` and writing `out` device pointers,
+     * one per input or output in the order given to the constructor. The
+     * kernel must depend on `deps` */
+    typedef std::function<sycl::event(sycl::queue &q, const std::vector<sycl::event> &deps,
+                                      void *const *in, void *const *out)> kernel_t;
+
+private:
+    sycl::queue &queue;
+    std::vector<size_t> in_bytes;
+    std::vector<size_t> out_bytes;
+
+    /* [slot][index] device allocations */
+    std::vector<void *> in_dev[2];
+    std::vector<void *> out_dev[2];
+
+public:
+    /* Device memory for two slots of inputs and outputs of the given sizes */
+    SyclPipeline(sycl::queue &queue, const std::vector<size_t> &in_bytes, const std::vector<size_t> &out_bytes);
+    ~SyclPipeline();
+
+    SyclPipeline(const SyclPipeline &) = delete;
+    SyclPipeline &operator=(const SyclPipeline &) = delete;
+
+    /* Run `runs` iterations from the host inputs to the host outputs,
+     * returning the total time in nanoseconds or -1 on failure */
+    double run(size_t runs, const void *const *host_in, void *const *host_out, const kernel_t &kernel);
+};
+
+#endif
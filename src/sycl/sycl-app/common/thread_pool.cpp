@@ -0,0 +1,274 @@
+#include "common/thread_pool.hpp"
+
+#include <algorithm>
+#include <iostream>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+/* Idle polls before a worker goes to sleep, keeps back-to-back jobs from
+ * paying the condition variable wake-up latency */
+#define POOL_SPIN_COUNT 20000
+
+static inline void cpu_relax() {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#endif
+}
+
+/* CPUs the process may run on, in ascending order */
+static std::vector<unsigned> allowed_cpus() {
+    std::vector<unsigned> cpus;
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+        for (unsigned cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+            if (CPU_ISSET(cpu, &set)) {
+                cpus.push_back(cpu);
+            }
+        }
+    }
+#endif
+    if (cpus.empty()) {
+        unsigned cores = std::thread::hardware_concurrency();
+        for (unsigned cpu = 0; cpu < std::max(cores, 1u); cpu++) {
+            cpus.push_back(cpu);
+        }
+    }
+    return cpus;
+}
+
+/* Returns 0 on success, -1 if the thread was left where it was */
+static int pin_to_cpu(std::thread::native_handle_type thread, unsigned cpu) {
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return pthread_setaffinity_np(thread, sizeof(set), &set) ? -1 : 0;
+#else
+    /* Nothing to pin to elsewhere, threads are left to the scheduler */
+    return 0;
+#endif
+}
+
+ThreadPool::ThreadPool(int n_workers, bool pin) : cpus(allowed_cpus()), pin(pin) {
+    if (n_workers < 0) {
+        n_workers = this->cpus.size() - 1;
+    }
+
+    for (auto i = 0; i < n_workers; i++) {
+        this->workers.emplace_back(new Worker());
+    }
+
+    for (auto i = 0; i < n_workers; i++) {
+        auto &w = *this->workers[i];
+        w.thread = std::thread(&ThreadPool::worker_main, this, i);
+        /* The submitting thread is expected on the first allowed CPU */
+        auto cpu = this->cpus[(i + 1) % this->cpus.size()];
+        if (pin && pin_to_cpu(w.thread.native_handle(), cpu)) {
+            std::cerr << "Failed to pin pool worker " << i << " to CPU " << cpu << std::endl;
+        }
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> guard(this->sleep_lock);
+        this->stop = true;
+    }
+    this->wake.notify_all();
+
+    for (auto &w : this->workers) {
+        w->thread.join();
+    }
+}
+
+bool ThreadPool::pop(size_t worker, Task &task) {
+    auto &w = *this->workers[worker];
+    std::lock_guard<std::mutex> guard(w.lock);
+    if (w.head == w.tail) {
+        return false;
+    }
+    w.tail--;
+    task = w.ring[w.tail % RING_SIZE];
+    this->pending--;
+    return true;
+}
+
+bool ThreadPool::steal(size_t thief, Task &task) {
+    auto n = this->workers.size();
+    for (size_t i = 1; i <= n; i++) {
+        auto &w = *this->workers[(thief + i) % n];
+        std::lock_guard<std::mutex> guard(w.lock);
+        if ((w.head == w.tail) || w.ring[w.head % RING_SIZE].pinned) {
+            continue;
+        }
+        task = w.ring[w.head % RING_SIZE];
+        w.head++;
+        this->pending--;
+        return true;
+    }
+    return false;
+}
+
+bool ThreadPool::take(size_t worker, Task &task) {
+    if (this->pending.load(std::memory_order_acquire) == 0) {
+        return false;
+    }
+    return this->pop(worker, task) || this->steal(worker, task);
+}
+
+void ThreadPool::run_task(Task &task) {
+    task.call(task.ctx, task.idx);
+    task.remaining->fetch_sub(1, std::memory_order_release);
+}
+
+void ThreadPool::worker_main(size_t worker) {
+    while (true) {
+        Task task;
+        if (this->take(worker, task)) {
+            this->run_task(task);
+            continue;
+        }
+
+        auto found = false;
+        for (auto spin = 0; spin < POOL_SPIN_COUNT; spin++) {
+            if (this->pending.load(std::memory_order_relaxed) || this->stop.load(std::memory_order_relaxed)) {
+                found = true;
+                break;
+            }
+            cpu_relax();
+        }
+
+        if (!found) {
+            std::unique_lock<std::mutex> lock(this->sleep_lock);
+            this->wake.wait(lock, [this] { return this->stop || this->pending.load() > 0; });
+        }
+
+        if (this->stop && (this->pending.load() == 0)) {
+            return;
+        }
+    }
+}
+
+void ThreadPool::run(size_t count, void (*call)(void *, size_t), void *ctx) {
+    if (count == 0) {
+        return;
+    }
+
+    if (this->workers.empty() || (count == 1)) {
+        for (size_t i = 0; i < count; i++) {
+            call(ctx, i);
+        }
+        return;
+    }
+
+    std::atomic<size_t> remaining{count};
+    auto n = this->workers.size();
+    auto start = this->next_worker.fetch_add(1) % n;
+
+    /* Hand out tasks round-robin, anything that does not fit in a ring runs
+     * inline on the caller */
+    size_t queued = 0;
+    for (size_t i = 0; i < count; i++) {
+        Task task{call, ctx, i, &remaining, false};
+        auto &w = *this->workers[(start + i) % n];
+        {
+            std::lock_guard<std::mutex> guard(w.lock);
+            if (w.tail - w.head < RING_SIZE) {
+                w.ring[w.tail % RING_SIZE] = task;
+                w.tail++;
+                this->pending.fetch_add(1, std::memory_order_release);
+                queued++;
+                task.call = nullptr;
+            }
+        }
+        if (task.call) {
+            this->run_task(task);
+        }
+    }
+
+    if (queued) {
+        {
+            std::lock_guard<std::mutex> guard(this->sleep_lock);
+        }
+        this->wake.notify_all();
+    }
+
+    /* Help out until our own job is done */
+    while (remaining.load(std::memory_order_acquire) != 0) {
+        Task task;
+        if ((this->pending.load(std::memory_order_acquire) != 0) && this->steal(start, task)) {
+            this->run_task(task);
+        } else {
+            cpu_relax();
+        }
+    }
+}
+
+void ThreadPool::run_each(void (*call)(void *, size_t), void *ctx) {
+    auto n = this->workers.size();
+    std::atomic<size_t> remaining{n};
+
+    /* One pinned task at the back of each worker's own ring, a full ring
+     * would only happen with a job already running and is waited out */
+    for (size_t i = 0; i < n; i++) {
+        auto &w = *this->workers[i];
+        while (true) {
+            std::lock_guard<std::mutex> guard(w.lock);
+            if (w.tail - w.head < RING_SIZE) {
+                w.ring[w.tail % RING_SIZE] = Task{call, ctx, i + 1, &remaining, true};
+                w.tail++;
+                this->pending.fetch_add(1, std::memory_order_release);
+                break;
+            }
+        }
+    }
+
+    if (n) {
+        {
+            std::lock_guard<std::mutex> guard(this->sleep_lock);
+        }
+        this->wake.notify_all();
+    }
+
+    call(ctx, 0);
+
+    /* The tasks cannot be helped with, give the core up once it looks like
+     * the workers need it */
+    for (size_t spin = 0; remaining.load(std::memory_order_acquire) != 0; spin++) {
+        if (spin < POOL_SPIN_COUNT) {
+            cpu_relax();
+        } else {
+            std::this_thread::yield();
+        }
+    }
+}
+
+ThreadPool::CallerPin::CallerPin(const ThreadPool &pool) {
+#ifdef __linux__
+    auto cpu = pool.cpus[0];
+    if (!pool.pin || pthread_getaffinity_np(pthread_self(), sizeof(this->saved), &this->saved)) {
+        return;
+    }
+    if (pin_to_cpu(pthread_self(), cpu)) {
+        static std::atomic<bool> warned{false};
+        if (!warned.exchange(true)) {
+            std::cerr << "Failed to pin the calling thread to CPU " << cpu << std::endl;
+        }
+        return;
+    }
+    this->pinned = true;
+#endif
+}
+
+ThreadPool::CallerPin::~CallerPin() {
+#ifdef __linux__
+    if (this->pinned) {
+        pthread_setaffinity_np(pthread_self(), sizeof(this->saved), &this->saved);
+    }
+#endif
+}
@@ -0,0 +1,128 @@
+#ifndef THREAD_POOL_HPP
+#define THREAD_POOL_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#ifdef __linux__
+#include <sched.h>
+#endif
+#include <type_traits>
+#include <vector>
+
+/*
+ * Persistent work-stealing thread pool
+ *
+ * Workers are created once and pinned to a CPU each, taken from the process
+ * affinity mask so runs under taskset or numactl stay on the CPUs they were
+ * given. Every worker owns a fixed-size task ring: the owner pops from the
+ * back, idle workers steal from the front of the others. The submitting thread takes part in running its own
+ * job, so a pool with zero workers just runs everything inline. Submission
+ * does not allocate.
+ *
+ * Create one pool per process and hand it to everything that needs threads,
+ * pools side by side would pin their workers to the same CPUs and spin
+ * against each other after every job.
+ */
+class ThreadPool {
+private:
+    struct Task {
+        void (*call)(void *ctx, size_t idx);
+        void *ctx;
+        size_t idx;
+        std::atomic<size_t> *remaining;
+        /* Only the owning worker may run it */
+        bool pinned;
+    };
+
+    static const size_t RING_SIZE = 1024;
+
+    struct Worker {
+        std::mutex lock;
+        Task ring[RING_SIZE];
+        size_t head = 0;
+        size_t tail = 0;
+        std::thread thread;
+    };
+
+    std::vector<std::unique_ptr<Worker>> workers;
+
+    /* CPUs of the process affinity mask, worker i runs on cpus[(i + 1) % n] */
+    std::vector<unsigned> cpus;
+    bool pin;
+
+    std::mutex sleep_lock;
+    std::condition_variable wake;
+    std::atomic<size_t> pending{0};
+    std::atomic<bool> stop{false};
+
+    /* Round-robin start for task distribution */
+    std::atomic<size_t> next_worker{0};
+
+    bool pop(size_t worker, Task &task);
+    bool steal(size_t thief, Task &task);
+    bool take(size_t worker, Task &task);
+    void run_task(Task &task);
+    void worker_main(size_t worker);
+    void run(size_t count, void (*call)(void *, size_t), void *ctx);
+    void run_each(void (*call)(void *, size_t), void *ctx);
+
+public:
+    /* `n_workers` threads in addition to the caller, a negative count picks
+     * one per allowed CPU minus the calling thread */
+    ThreadPool(int n_workers = -1, bool pin = true);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    /* Number of threads that take part in a job, including the caller */
+    size_t concurrency() const { return this->workers.size() + 1; }
+
+    /* Run fn(i) for every i in [0, count) and wait for all of them */
+    template <typename F>
+    void parallel_for(size_t count, F &&fn) {
+        auto call = [](void *ctx, size_t idx) {
+            (*static_cast<std::remove_reference_t<F> *>(ctx))(idx);
+        };
+        this->run(count, call, (void *)&fn);
+    }
+
+    /* Run fn(t) once on every thread t in [0, concurrency()), the caller
+     * being thread 0 and worker i thread i + 1, and wait for all of them.
+     * Nothing is stolen, so with the caller held by a CallerPin fn(t) always
+     * runs on the same core and memory it first touches stays on that core's
+     * NUMA node */
+    template <typename F>
+    void parallel_for_each_thread(F &&fn) {
+        auto call = [](void *ctx, size_t idx) {
+            (*static_cast<std::remove_reference_t<F> *>(ctx))(idx);
+        };
+        this->run_each(call, (void *)&fn);
+    }
+
+    /* Pins the calling thread to the CPU the pool leaves free for it while in
+     * scope, then puts back the affinity it had before. Does nothing for a
+     * pool that does not pin. Pinning is two system calls, so hold one around
+     * a whole measurement rather than each job */
+    class CallerPin {
+    private:
+#ifdef __linux__
+        cpu_set_t saved;
+#endif
+        bool pinned = false;
+
+    public:
+        CallerPin(const ThreadPool &pool);
+        ~CallerPin();
+
+        CallerPin(const CallerPin &) = delete;
+        CallerPin &operator=(const CallerPin &) = delete;
+    };
+};
+
+#endif
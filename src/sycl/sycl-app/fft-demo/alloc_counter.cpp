@@ -0,0 +1,76 @@
+#include "alloc_counter.hpp"
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+/*
+ * Replacement global allocation functions that count every allocation. The
+ * nothrow and array forms forward to these in the standard library.
+ */
+
+static std::atomic<size_t> n_allocs{0};
+
+size_t alloc_count() {
+    return n_allocs.load(std::memory_order_relaxed);
+}
+
+#ifndef __SYCL_DEVICE_ONLY__
+void *operator new(size_t size) {
+    n_allocs.fetch_add(1, std::memory_order_relaxed);
+    if (auto ptr = std::malloc(size ? size : 1)) {
+        return ptr;
+    }
+    throw std::bad_alloc();
+}
+
+void *operator new(size_t size, std::align_val_t align) {
+    n_allocs.fetch_add(1, std::memory_order_relaxed);
+    auto a = (size_t)align;
+    /* aligned_alloc needs the size to be a multiple of the alignment */
+    if (auto ptr = std::aligned_alloc(a, ((size ? size : 1) + a - 1) / a * a)) {
+        return ptr;
+    }
+    throw std::bad_alloc();
+}
+
+void *operator new[](size_t size) {
+    return operator new(size);
+}
+
+void *operator new[](size_t size, std::align_val_t align) {
+    return operator new(size, align);
+}
+
+void operator delete(void *ptr) noexcept {
+    std::free(ptr);
+}
+
+void operator delete(void *ptr, size_t) noexcept {
+    std::free(ptr);
+}
+
+void operator delete(void *ptr, std::align_val_t) noexcept {
+    std::free(ptr);
+}
+
+void operator delete(void *ptr, size_t, std::align_val_t) noexcept {
+    std::free(ptr);
+}
+
+void operator delete[](void *ptr) noexcept {
+    std::free(ptr);
+}
+
+void operator delete[](void *ptr, size_t) noexcept {
+    std::free(ptr);
+}
+
+void operator delete[](void *ptr, std::align_val_t) noexcept {
+    std::free(ptr);
+}
+
+void operator delete[](void *ptr, size_t, std::align_val_t) noexcept {
+    std::free(ptr);
+}
+#endif /* __SYCL_DEVICE_ONLY__ */
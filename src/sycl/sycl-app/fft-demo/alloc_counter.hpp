@@ -0,0 +1,10 @@
+#ifndef ALLOC_COUNTER_HPP
+#define ALLOC_COUNTER_HPP
+
+#include <cstddef>
+
+/* Number of heap allocations made through global operator new since start-up,
+ * used by the benchmarks to check that hot paths do not allocate */
+size_t alloc_count();
+
+#endif
@@ -0,0 +1,300 @@
+#include "conv.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <map>
+#include <mutex>
+
+/*
+ * Streaming FIR filter
+ */
+
+/* The direct/overlap-save crossover is measured over filters of
+ * CONV_CALIBRATE_MIN to CONV_CALIBRATE_MAX taps, doubling, each filtering
+ * CONV_CALIBRATE_SAMPLES samples. It ends once overlap-save has won
+ * CONV_CALIBRATE_CONFIRM lengths in a row, direct cost only grows from there */
+#define CONV_CALIBRATE_MIN 4
+#define CONV_CALIBRATE_MAX 4096
+#define CONV_CALIBRATE_SAMPLES (1 << 15)
+#define CONV_CALIBRATE_CHUNK 1024
+#define CONV_CALIBRATE_CONFIRM 2
+
+/* Direct form works through the input in pieces of this many samples */
+#define CONV_DIRECT_BLOCK 1024
+
+/* Transform size is the smallest power of two of at least this many times the
+ * filter length, trading transform cost against samples per block */
+#define CONV_FFT_RATIO 4
+#define CONV_FFT_MIN 64
+
+size_t FIRFilter::direct_max_taps(FFTProvider &provider) {
+    static std::mutex lock;
+    static std::map<std::string, size_t> measured;
+
+    auto ident = provider.ident();
+    std::lock_guard<std::mutex> guard(lock);
+    auto found = measured.find(ident);
+    if (found != measured.end()) {
+        return found->second;
+    }
+
+    std::vector<fval_t> taps(CONV_CALIBRATE_MAX);
+    for (size_t k = 0; k < taps.size(); k++) {
+        taps[k] = (fval_t)((k * 7919) % 1024) / 1024.0f / (fval_t)taps.size();
+    }
+
+    size_t direct_max = 0;
+    size_t fft_wins = 0;
+    for (size_t n_taps = CONV_CALIBRATE_MIN; n_taps <= CONV_CALIBRATE_MAX; n_taps <<= 1) {
+        FIRFilter direct(provider, taps.data(), n_taps, ConvMethod::Direct);
+        FIRFilter ols(provider, taps.data(), n_taps, ConvMethod::OverlapSave);
+        auto direct_rate = direct.benchmark(CONV_CALIBRATE_SAMPLES, CONV_CALIBRATE_CHUNK);
+        auto ols_rate = ols.benchmark(CONV_CALIBRATE_SAMPLES, CONV_CALIBRATE_CHUNK);
+
+        if (direct_rate >= ols_rate) {
+            direct_max = n_taps;
+            fft_wins = 0;
+        } else if (++fft_wins >= CONV_CALIBRATE_CONFIRM) {
+            break;
+        }
+    }
+
+    measured[ident] = direct_max;
+    return direct_max;
+}
+
+ConvMethod FIRFilter::choose(FFTProvider &provider, size_t n_taps) {
+    return (n_taps <= direct_max_taps(provider)) ? ConvMethod::Direct : ConvMethod::OverlapSave;
+}
+
+FIRFilter::FIRFilter(FFTProvider &provider, const fval_t *taps, size_t n_taps, ConvMethod method) :
+provider(provider), method(method), n_taps(std::max<size_t>(n_taps, 1)) {
+    if (this->method == ConvMethod::Auto) {
+        this->method = choose(provider, this->n_taps);
+    }
+
+    this->taps_rev.assign(this->n_taps, 0);
+    for (size_t k = 0; k < n_taps; k++) {
+        this->taps_rev[this->n_taps - 1 - k] = taps[k];
+    }
+
+    if (this->method == ConvMethod::Direct) {
+        this->work.resize(this->n_taps - 1 + CONV_DIRECT_BLOCK);
+    } else {
+        this->fft_size = CONV_FFT_MIN;
+        while (this->fft_size < this->n_taps * CONV_FFT_RATIO) {
+            this->fft_size <<= 1;
+        }
+        this->block = this->fft_size - this->n_taps + 1;
+
+        /* Filter spectrum, computed once */
+        this->work.assign(this->fft_size, 0);
+        std::copy(taps, taps + n_taps, this->work.begin());
+        this->filter_spectrum.resize(this->fft_size / 2 + 1);
+        this->spectrum.resize(this->fft_size / 2 + 1);
+        if (this->provider.rfft(this->fft_size, this->work.data(), this->filter_spectrum.data())) {
+            this->error = -1;
+        }
+    }
+
+    this->history.resize(this->n_taps - 1);
+    this->reset();
+}
+
+std::string FIRFilter::ident() {
+    switch (this->method) {
+    case ConvMethod::Direct:
+        return "direct";
+    case ConvMethod::OverlapAdd:
+        return "ola " + this->provider.ident();
+    default:
+        return "ols " + this->provider.ident();
+    }
+}
+
+void FIRFilter::reset() {
+    std::fill(this->history.begin(), this->history.end(), 0);
+}
+
+int FIRFilter::process(const fval_t *input, size_t count, fval_t *output) {
+    if (this->error) {
+        return -1;
+    }
+
+    switch (this->method) {
+    case ConvMethod::Direct:
+        return this->process_direct(input, count, output);
+    case ConvMethod::OverlapAdd:
+        return this->process_ola(input, count, output);
+    default:
+        return this->process_ols(input, count, output);
+    }
+}
+
+int FIRFilter::process_direct(const fval_t *input, size_t count, fval_t *output) {
+    auto hist = this->n_taps - 1;
+    auto line = this->work.data();
+    auto taps = this->taps_rev.data();
+
+    std::copy(this->history.begin(), this->history.end(), line);
+
+    while (count) {
+        auto n = std::min<size_t>(count, CONV_DIRECT_BLOCK);
+        std::copy(input, input + n, line + hist);
+
+        /* Taps outermost, so the inner loop runs across independent outputs
+         * and vectorizes without reassociating the sums */
+        std::fill(output, output + n, 0);
+        for (size_t k = 0; k < this->n_taps; k++) {
+            auto tap = taps[k];
+            auto src = line + k;
+            for (size_t i = 0; i < n; i++) {
+                output[i] += tap * src[i];
+            }
+        }
+
+        std::memmove(line, line + n, hist * sizeof(fval_t));
+        input += n;
+        output += n;
+        count -= n;
+    }
+
+    std::copy(line, line + hist, this->history.begin());
+    return 0;
+}
+
+/* Multiply a spectrum by the filter spectrum in place */
+static void spectrum_mul(size_t n_bins, cfval_t *spectrum, const cfval_t *filter) {
+    for (size_t k = 0; k < n_bins; k++) {
+        auto a = spectrum[k];
+        auto b = filter[k];
+        spectrum[k] = cfval_t(a.real() * b.real() - a.imag() * b.imag(),
+                              a.real() * b.imag() + a.imag() * b.real());
+    }
+}
+
+int FIRFilter::process_ola(const fval_t *input, size_t count, fval_t *output) {
+    auto hist = this->n_taps - 1;
+    auto frame = this->work.data();
+    auto tail = this->history.data();
+    auto n_bins = this->fft_size / 2 + 1;
+
+    while (count) {
+        /* Any n up to a block keeps the n + hist output samples free of
+         * circular wrap-around */
+        auto n = std::min(count, this->block);
+        std::copy(input, input + n, frame);
+        std::fill(frame + n, frame + this->fft_size, 0);
+
+        if (this->provider.rfft(this->fft_size, frame, this->spectrum.data())) {
+            return -1;
+        }
+        spectrum_mul(n_bins, this->spectrum.data(), this->filter_spectrum.data());
+        if (this->provider.irfft(this->fft_size, this->spectrum.data(), frame)) {
+            return -1;
+        }
+
+        /* Emit n samples with the pending tail added, then carry the rest of
+         * the old tail and the new one forward */
+        auto emit = std::min(n, hist);
+        for (size_t i = 0; i < emit; i++) {
+            output[i] = frame[i] + tail[i];
+        }
+        for (size_t i = emit; i < n; i++) {
+            output[i] = frame[i];
+        }
+        for (size_t i = 0; i < hist; i++) {
+            auto carried = (i + n < hist) ? tail[i + n] : 0;
+            tail[i] = carried + frame[n + i];
+        }
+
+        input += n;
+        output += n;
+        count -= n;
+    }
+
+    return 0;
+}
+
+int FIRFilter::process_ols(const fval_t *input, size_t count, fval_t *output) {
+    auto hist = this->n_taps - 1;
+    auto frame = this->work.data();
+    auto n_bins = this->fft_size / 2 + 1;
+
+    while (count) {
+        /* The first hist outputs of each transform are wrapped and discarded,
+         * the next n are exact */
+        auto n = std::min(count, this->block);
+        std::copy(this->history.begin(), this->history.end(), frame);
+        std::copy(input, input + n, frame + hist);
+        std::fill(frame + hist + n, frame + this->fft_size, 0);
+
+        /* New history is the last hist samples of [old history, input] */
+        if (n >= hist) {
+            std::copy(input + n - hist, input + n, this->history.begin());
+        } else {
+            std::copy(frame + n, frame + n + hist, this->history.begin());
+        }
+
+        if (this->provider.rfft(this->fft_size, frame, this->spectrum.data())) {
+            return -1;
+        }
+        spectrum_mul(n_bins, this->spectrum.data(), this->filter_spectrum.data());
+        if (this->provider.irfft(this->fft_size, this->spectrum.data(), frame)) {
+            return -1;
+        }
+
+        std::copy(frame + hist, frame + hist + n, output);
+
+        input += n;
+        output += n;
+        count -= n;
+    }
+
+    return 0;
+}
+
+float FIRFilter::benchmark(size_t n_samples, size_t chunk) {
+    std::vector<fval_t> input(chunk);
+    std::vector<fval_t> output(chunk);
+    for (size_t i = 0; i < chunk; i++) {
+        input[i] = (fval_t)((i * 7919) % 1024) / 512.0f - 1.0f;
+    }
+
+    this->reset();
+    if (this->process(input.data(), chunk, output.data())) {
+        return 0;
+    }
+
+    auto start = std::chrono::high_resolution_clock::now();
+
+    for (size_t done = 0; done < n_samples; done += chunk) {
+        if (this->process(input.data(), chunk, output.data())) {
+            return 0;
+        }
+    }
+
+    auto end = std::chrono::high_resolution_clock::now();
+
+    auto runtime = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+
+    return (float)n_samples * 1e9f / (float)runtime;
+}
+
+BenchStats FIRFilter::measure(const BenchOptions &opts, size_t chunk) {
+    std::vector<fval_t> input(chunk);
+    std::vector<fval_t> output(chunk);
+    for (size_t i = 0; i < chunk; i++) {
+        input[i] = (fval_t)((i * 7919) % 1024) / 512.0f - 1.0f;
+    }
+
+    this->reset();
+    if (this->process(input.data(), chunk, output.data())) {
+        return BenchStats();
+    }
+
+    return bench_measure_calls(opts, [&]() {
+        return this->process(input.data(), chunk, output.data());
+    });
+}
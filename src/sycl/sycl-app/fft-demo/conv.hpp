@@ -0,0 +1,78 @@
+#ifndef CONV_HPP
+#define CONV_HPP
+
+#include "fft.hpp"
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+enum class ConvMethod {
+    Auto,
+    Direct,
+    OverlapAdd,
+    OverlapSave,
+};
+
+/*
+ * Streaming FIR filter
+ *
+ * Computes y[n] = sum_k taps[k] * x[n - k] over consecutive calls to
+ * process(), with any chunk size and no added latency. Short filters run as a
+ * direct dot product, long ones through the provider's real transform with the
+ * filter spectrum computed once, either overlap-add (carrying the convolution
+ * tail between blocks) or overlap-save (carrying the last n_taps - 1 inputs).
+ * Where short turns into long is measured per provider, see direct_max_taps().
+ */
+class FIRFilter {
+private:
+    FFTProvider &provider;
+    ConvMethod method;
+    size_t n_taps;
+    int error = 0;
+
+    /* Taps in reverse order, so the direct form is a forward dot product */
+    std::vector<fval_t> taps_rev;
+
+    /* Transform size, and input samples per transform */
+    size_t fft_size = 0;
+    size_t block = 0;
+    std::vector<cfval_t> filter_spectrum;
+
+    /* Last n_taps - 1 inputs (direct, overlap-save) or pending output tail
+     * (overlap-add), followed by working space */
+    std::vector<fval_t> history;
+    std::vector<fval_t> work;
+    std::vector<cfval_t> spectrum;
+
+    int process_direct(const fval_t *input, size_t count, fval_t *output);
+    int process_ola(const fval_t *input, size_t count, fval_t *output);
+    int process_ols(const fval_t *input, size_t count, fval_t *output);
+
+public:
+    FIRFilter(FFTProvider &provider, const fval_t *taps, size_t n_taps, ConvMethod method = ConvMethod::Auto);
+
+    /* Method used for a filter of `n_taps` when constructed with Auto */
+    static ConvMethod choose(FFTProvider &provider, size_t n_taps);
+
+    /* Longest filter that ran faster in direct form than as overlap-save with
+     * `provider`, 0 if overlap-save always won. Measured the first time a
+     * provider is asked for and kept for the process */
+    static size_t direct_max_taps(FFTProvider &provider);
+
+    /* False when the filter spectrum could not be computed, process() then
+     * fails */
+    bool ok() const { return !this->error; }
+
+    std::string ident();
+    void reset();
+
+    int process(const fval_t *input, size_t count, fval_t *output);
+
+    /* Samples per second filtering `n_samples` in chunks of `chunk` */
+    float benchmark(size_t n_samples, size_t chunk);
+    /* Time distribution of filtering one chunk of `chunk` samples */
+    BenchStats measure(const BenchOptions &opts, size_t chunk);
+};
+
+#endif
@@ -1,26 +1,45 @@
 #include "fft.hpp"
+#include "alloc_counter.hpp"
 
+#include <algorithm>
 #include <chrono>
 #include <cmath>
 #include <complex>
 #include <cstring>
 #include <string>
-#include <thread>
+#include <type_traits>
 #include <vector>
 
-void gen_data(size_t count, cfval_t *data) {
+template <typename T>
+void gen_data(size_t count, std::complex<T> *data) {
     for (auto i = 0; i < count; i++) {
         fval_t point = sin((fval_t)i * M_PI / 8.) * 2.0;
         point += sin((M_PI / 2.) + (fval_t)i * M_PI / 2.) * 1.0;
-        data[i] = cfval_t(point, 0);
+        data[i] = std::complex<T>((T)point, 0);
     }
 }
 
-float FFTProvider::benchmark(size_t count, size_t n_points) {
-    auto xt_data = new cfval_t[n_points];
-    auto xf_data = new cfval_t[n_points];
+/* Multiply by -i, a swap and a negate rather than a complex multiply */
+template <typename T>
+static inline std::complex<T> mul_neg_i(std::complex<T> v) {
+    return std::complex<T>(v.imag(), -v.real());
+}
+
+template <typename T>
+float FFTProviderT<T>::benchmark(size_t count, size_t n_points, float *allocs_per_fft) {
+    std::vector<sample_t> xt_buf(n_points);
+    std::vector<sample_t> xf_buf(n_points);
+    auto xt_data = xt_buf.data();
+    auto xf_data = xf_buf.data();
     gen_data(n_points, xt_data);
 
+    /* One untimed run so plan creation and other one-off setup is neither
+     * timed nor counted as a per-transform allocation */
+    if (this->fft(n_points, xt_data, xf_data)) {
+        return 0;
+    }
+
+    auto allocs_start = alloc_count();
     auto start = std::chrono::high_resolution_clock::now();
 
     for (auto i = 0; i < count; i++) {
@@ -30,12 +49,365 @@ float FFTProvider::benchmark(size_t count, size_t n_points) {
     }
 
     auto end = std::chrono::high_resolution_clock::now();
+    auto allocs_end = alloc_count();
 
     auto runtime = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
 
+    if (allocs_per_fft) {
+        *allocs_per_fft = (float)(allocs_end - allocs_start) / (float)count;
+    }
+
     return (float)count * 1e9f / (float)runtime;
 }
 
+template <typename T>
+BenchStats FFTProviderT<T>::measure(const BenchOptions &opts, size_t n_points, float *allocs_per_fft) {
+    std::vector<sample_t> xt_data(n_points);
+    std::vector<sample_t> xf_data(n_points);
+    gen_data(n_points, xt_data.data());
+
+    /* Plan creation and other one-off setup happen in the first call */
+    if (this->fft(n_points, xt_data.data(), xf_data.data())) {
+        return BenchStats();
+    }
+
+    /* Only allocations inside the transform count, not the harness' own */
+    size_t calls = 0;
+    size_t allocs = 0;
+
+    auto stats = bench_measure_calls(opts, [&]() {
+        auto allocs_start = alloc_count();
+        auto res = this->fft(n_points, xt_data.data(), xf_data.data());
+        allocs += alloc_count() - allocs_start;
+        calls++;
+        return res;
+    });
+
+    if (allocs_per_fft) {
+        *allocs_per_fft = calls ? (float)allocs / (float)calls : 0;
+    }
+
+    return stats;
+}
+
+template <typename T>
+float FFTProviderT<T>::benchmark_batch(size_t count, size_t n_points, size_t batch) {
+    std::vector<sample_t> xt_data(n_points * batch);
+    std::vector<sample_t> xf_data(n_points * batch);
+    for (size_t b = 0; b < batch; b++) {
+        gen_data(n_points, xt_data.data() + b * n_points);
+    }
+
+    if (this->fft_batch(n_points, batch, n_points, xt_data.data(), xf_data.data())) {
+        return 0;
+    }
+
+    auto start = std::chrono::high_resolution_clock::now();
+
+    for (auto i = 0; i < count; i++) {
+        if (this->fft_batch(n_points, batch, n_points, xt_data.data(), xf_data.data())) {
+            return 0;
+        }
+    }
+
+    auto end = std::chrono::high_resolution_clock::now();
+
+    auto runtime = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+
+    return (float)(count * batch) * 1e9f / (float)runtime;
+}
+
+template <typename T>
+BenchStats FFTProviderT<T>::measure_batch(const BenchOptions &opts, size_t n_points, size_t batch) {
+    std::vector<sample_t> xt_data(n_points * batch);
+    std::vector<sample_t> xf_data(n_points * batch);
+    for (size_t b = 0; b < batch; b++) {
+        gen_data(n_points, xt_data.data() + b * n_points);
+    }
+
+    if (this->fft_batch(n_points, batch, n_points, xt_data.data(), xf_data.data())) {
+        return BenchStats();
+    }
+
+    return bench_measure_calls(opts, [&]() {
+        return this->fft_batch(n_points, batch, n_points, xt_data.data(), xf_data.data());
+    });
+}
+
+template <typename T>
+BenchStats FFTProviderT<T>::measure_real(const BenchOptions &opts, size_t n_points) {
+    std::vector<sample_t> xt_data(n_points);
+    std::vector<T> xt_real(n_points);
+    std::vector<sample_t> xf_data(n_points / 2 + 1);
+    gen_data(n_points, xt_data.data());
+    for (size_t i = 0; i < n_points; i++) {
+        xt_real[i] = xt_data[i].real();
+    }
+
+    if (this->rfft(n_points, xt_real.data(), xf_data.data())) {
+        return BenchStats();
+    }
+
+    return bench_measure_calls(opts, [&]() {
+        return this->rfft(n_points, xt_real.data(), xf_data.data());
+    });
+}
+
+template <typename T>
+int FFTProviderT<T>::fft_batch(size_t count, size_t batch, size_t stride, sample_t *input, sample_t *output) {
+    for (size_t b = 0; b < batch; b++) {
+        if (this->fft(count, input + b * stride, output + b * stride)) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/*
+ * Inverse and real-input transforms, shared by all providers
+ */
+template <typename T>
+void FFTProviderT<T>::real_twiddles_for(size_t count) {
+    if (this->real_twiddles.size() == count / 2) {
+        return;
+    }
+
+    this->real_twiddles.resize(count / 2);
+    for (size_t k = 0; k < count / 2; k++) {
+        auto angle = -2.L * (long double)M_PI * (long double)k / (long double)count;
+        this->real_twiddles[k] = sample_t((T)std::cos(angle), (T)std::sin(angle));
+    }
+}
+
+/* Uses ifft(x) = conj(fft(conj(x))) / count */
+template <typename T>
+int FFTProviderT<T>::ifft(size_t count, const sample_t *input, sample_t *output) {
+    if (this->scratch.size() < count) {
+        this->scratch.resize(count);
+    }
+
+    auto buf = this->scratch.data();
+    for (size_t i = 0; i < count; i++) {
+        buf[i] = std::conj(input[i]);
+    }
+
+    if (this->fft(count, buf, output)) {
+        return -1;
+    }
+
+    auto scale = (T)1 / (T)count;
+    for (size_t i = 0; i < count; i++) {
+        output[i] = std::conj(output[i]) * scale;
+    }
+
+    return 0;
+}
+
+/*
+ * With z[n] = x[2n] + i x[2n+1] and Z its half-length transform, the spectra
+ * of the even and odd samples are
+ *     E[k] = (Z[k] + conj(Z[M-k])) / 2
+ *     O[k] = -i (Z[k] - conj(Z[M-k])) / 2
+ * and X[k] = E[k] + W_N^k O[k], X[M-k] = conj(E[k] - W_N^k O[k]).
+ */
+template <typename T>
+int FFTProviderT<T>::rfft(size_t count, const T *input, sample_t *output) {
+    if ((count < 2) || (count & (count - 1))) {
+        return -1;
+    }
+
+    auto half = count / 2;
+    this->real_twiddles_for(count);
+
+    /* Complex pairs of real samples have the same layout as sample_t */
+    auto packed = reinterpret_cast<sample_t *>(const_cast<T *>(input));
+    if (this->fft(half, packed, output)) {
+        return -1;
+    }
+
+    auto tw = this->real_twiddles.data();
+    for (size_t k = 1; k <= half / 2; k++) {
+        auto a = output[k];
+        auto b = std::conj(output[half - k]);
+        auto even = (a + b) * (T)0.5;
+        auto odd = mul_neg_i(a - b) * (T)0.5;
+        auto t = tw[k] * odd;
+        output[k] = even + t;
+        output[half - k] = std::conj(even - t);
+    }
+
+    auto z0 = output[0];
+    output[0] = sample_t(z0.real() + z0.imag(), 0);
+    output[half] = sample_t(z0.real() - z0.imag(), 0);
+
+    return 0;
+}
+
+/* Rebuilds Z[k] = E[k] + i O[k] from the bins and runs the half-length inverse
+ * straight into the real output */
+template <typename T>
+int FFTProviderT<T>::irfft(size_t count, const sample_t *input, T *output) {
+    if ((count < 2) || (count & (count - 1))) {
+        return -1;
+    }
+
+    auto half = count / 2;
+    this->real_twiddles_for(count);
+
+    if (this->scratch.size() < half) {
+        this->scratch.resize(half);
+    }
+
+    /* Build conj(Z) directly, ready for the conj(fft(conj(x))) inverse */
+    auto buf = this->scratch.data();
+    auto tw = this->real_twiddles.data();
+    for (size_t k = 0; k < half; k++) {
+        auto a = input[k];
+        auto b = std::conj(input[half - k]);
+        auto even = (a + b) * (T)0.5;
+        auto odd = (a - b) * std::conj(tw[k]) * (T)0.5;
+        buf[k] = std::conj(even + sample_t(-odd.imag(), odd.real()));
+    }
+
+    auto packed = reinterpret_cast<sample_t *>(output);
+    if (this->fft(half, buf, packed)) {
+        return -1;
+    }
+
+    auto scale = (T)1 / (T)half;
+    for (size_t i = 0; i < half; i++) {
+        packed[i] = std::conj(packed[i]) * scale;
+    }
+
+    return 0;
+}
+
+/*
+ * FFT plan
+ */
+template <typename T>
+FFTPlanT<T>::FFTPlanT(size_t count) {
+    this->count = count;
+    this->log2_count = (count > 1) ? __builtin_ctzl(count) : 0;
+
+    if (!this->supports(count)) {
+        /* Leave the tables empty, execute() will refuse to run */
+        this->count = 0;
+        return;
+    }
+
+    this->rev.resize(count);
+    for (size_t i = 0; i < count; i++) {
+        uint32_t r = 0;
+        auto val = i;
+        for (unsigned b = 0; b < this->log2_count; b++) {
+            r = (r << 1) | (val & 1);
+            val >>= 1;
+        }
+        this->rev[i] = r;
+    }
+
+    this->twiddles.resize(count > 1 ? count - 1 : 0);
+    for (size_t m = 2; m <= count; m <<= 1) {
+        auto tw = &this->twiddles[m / 2 - 1];
+        for (size_t j = 0; j < m / 2; j++) {
+            auto angle = -2.L * (long double)M_PI * (long double)j / (long double)m;
+            tw[j] = sample_t((T)std::cos(angle), (T)std::sin(angle));
+        }
+    }
+
+    this->twiddles4.resize(count >= 4 ? 3 * (count / 2 - 1) : 0);
+    for (size_t m = 4; m <= count; m <<= 1) {
+        auto tw = &this->twiddles4[3 * (m / 4 - 1)];
+        for (size_t j = 0; j < m / 4; j++) {
+            for (size_t r = 1; r <= 3; r++) {
+                auto angle = -2.L * (long double)M_PI * (long double)(r * j) / (long double)m;
+                tw[3 * j + r - 1] = sample_t((T)std::cos(angle), (T)std::sin(angle));
+            }
+        }
+    }
+}
+
+template <typename T>
+bool FFTPlanT<T>::supports(size_t n) const {
+    if ((n == 0) || (n & (n - 1))) {
+        /* Not a power of 2 */
+        return false;
+    }
+    return n <= this->count;
+}
+
+template <typename T>
+void FFTPlanT<T>::bit_reverse(size_t n, const sample_t *input, sample_t *output) const {
+    auto shift = this->log2_count - __builtin_ctzl(n);
+    for (size_t i = 0; i < n; i++) {
+        output[this->rev[i] >> shift] = input[i];
+    }
+}
+
+template <typename T>
+void FFTPlanT<T>::stages(size_t n, sample_t *data, unsigned first, unsigned last) const {
+    for (auto i = first; i <= last; i++) {
+        this->butterflies(data, i, 0, n / 2);
+    }
+}
+
+template <typename T>
+void FFTPlanT<T>::butterflies(sample_t *data, unsigned stage, size_t first, size_t last) const {
+    size_t m = 1 << stage;
+    auto half = m / 2;
+    auto tw = this->stage_twiddles(m);
+
+    auto b = first;
+    while (b < last) {
+        auto k = (b / half) * m;
+        auto j = b % half;
+        auto end = std::min(half, j + (last - b));
+        b += end - j;
+        for (; j < end; j++) {
+            auto t = tw[j] * data[k + j + half];
+            auto u = data[k + j];
+            data[k + j] = u + t;
+            data[k + j + half] = u - t;
+        }
+    }
+}
+
+template <typename T>
+int FFTPlanT<T>::execute(size_t n, const sample_t *input, sample_t *output) const {
+    if (!this->supports(n)) {
+        return -1;
+    }
+
+    this->bit_reverse(n, input, output);
+    this->stages(n, output, 1, __builtin_ctzl(n));
+
+    return 0;
+}
+
+template <typename T>
+const FFTPlanT<T> &FFTProviderT<T>::plan_for(size_t count) {
+    if (!this->plan || (this->plan->size() != count)) {
+        this->plan = std::make_unique<FFTPlanT<T>>(count);
+    }
+    return *this->plan;
+}
+
+template void gen_data(size_t count, std::complex<float> *data);
+template void gen_data(size_t count, std::complex<double> *data);
+template void gen_data(size_t count, std::complex<long double> *data);
+template class FFTPlanT<float>;
+template class FFTPlanT<double>;
+template class FFTPlanT<long double>;
+template class FFTProviderT<float>;
+template class FFTProviderT<double>;
+template class FFTProviderT<long double>;
+#if FFT_HAVE_FLOAT16
+template void gen_data(size_t count, std::complex<_Float16> *data);
+template class FFTPlanT<_Float16>;
+template class FFTProviderT<_Float16>;
+#endif
+
 static size_t rev_bits(size_t val, size_t bits) {
     /* Ineffecient, just for testiung for now */
     size_t res = 0;
@@ -59,32 +431,47 @@ static int bit_reverse_iterative(size_t count, const cfval_t *input, cfval_t *ou
     return 0;
 }
 
-static std::vector<std::vector<cfval_t>> split_problem(size_t count, const cfval_t *input, size_t split_pow) {
-    auto split = 1 << split_pow;
+/* Permute the input directly into the output so that each of the 2^split_pow
+ * sub-problems is contiguous. The full bit-reversal permutation does exactly
+ * this, and leaves every sub-problem in the bit-reversed order its in-place
+ * butterfly stages expect */
+static int split_problem(const FFTPlan &plan, size_t count, const cfval_t *input, cfval_t *output, size_t split_pow) {
+    if (!plan.supports(count) || ((count >> split_pow) == 0)) {
+        return -1;
+    }
 
-    /* Use bit-reversal to efficiently sort into separate vectors for parallel
-     * computation */
-    std::vector<std::vector<cfval_t>> sorted(split);
+    plan.bit_reverse(count, input, output);
 
-    auto bits = __builtin_ctz(count) - split_pow;
-    for (auto i = 0; i < count; i++) {
-        auto idx = rev_bits(i, __builtin_ctz(count)) >> bits;
-        sorted[idx].push_back(input[i]);
+    return 0;
+}
+
+/* Same split as above, but with each sub-problem left in natural order for
+ * algorithms that do their own reordering */
+static int split_problem_natural(const FFTPlan &plan, size_t count, const cfval_t *input, cfval_t *output, size_t split_pow) {
+    if (!plan.supports(count) || ((count >> split_pow) == 0)) {
+        return -1;
     }
 
-    return sorted;
+    size_t split = 1 << split_pow;
+    auto base_split_sz = count >> split_pow;
+    for (size_t i = 0; i < count; i++) {
+        auto idx = plan.reverse(i & (split - 1), split);
+        output[idx * base_split_sz + (i >> split_pow)] = input[i];
+    }
+
+    return 0;
 }
 
-#define USE_SLOW_JOIN 0
-static void join_problem(size_t count, cfval_t *data, size_t split_pow) {
-#if USE_SLOW_JOIN
+/* The original join, one butterfly at a time with twiddles from std::exp and a
+ * scratch buffer. Slow, but independent of FFTPlan */
+static void join_problem_slow(size_t count, cfval_t *data, size_t split_pow) {
     auto buf = new cfval_t[count];
     for (auto i = 0; i < split_pow; i++) {
         auto n_splits = 1 << (split_pow - i);
         auto split_sz = count >> (split_pow - i);
 
         for (auto j = 0; j < n_splits; j+=2) {
-            memset(buf, 0, split_sz * 2 * sizeof(cfval_t));
+            std::fill(buf, buf + split_sz * 2, cfval_t(0, 0));
             auto even = data + split_sz * j;
             auto odd = even + split_sz;
 
@@ -97,23 +484,31 @@ static void join_problem(size_t count, cfval_t *data, size_t split_pow) {
             memcpy(even, buf, split_sz * 2 * sizeof(cfval_t));
         }
     }
-#else
+    delete[] buf;
+}
+
+static void join_problem(const FFTPlan &plan, size_t count, cfval_t *data, size_t split_pow) {
+    plan.stages(count, data, __builtin_ctz(count) - split_pow + 1, __builtin_ctz(count));
+}
+
+/* Smallest number of butterflies worth handing to another thread */
+#define JOIN_MIN_CHUNK 2048
+
+/* Same as the fast join_problem, with each stage's butterflies spread over the
+ * pool. Small stages run inline where the hand-off would cost more than the
+ * work */
+static void join_problem_parallel(ThreadPool &pool, const FFTPlan &plan, size_t count, cfval_t *data, size_t split_pow) {
+    auto n_butterflies = count / 2;
+    auto chunks = std::min(pool.concurrency(), std::max<size_t>(1, n_butterflies / JOIN_MIN_CHUNK));
+    auto chunk_sz = (n_butterflies + chunks - 1) / chunks;
+
     for (auto i = __builtin_ctz(count) - split_pow + 1; i <= __builtin_ctz(count); i++) {
-        auto m = 1 << i;
-        auto cv = std::complex<fval_t>(0, -2. * M_PI / m);
-        auto omega_m = std::exp(cv);
-        for (auto k = 0; k < count; k += m) {
-            auto omega = std::complex<fval_t>(1., 0);
-            for (auto j = 0; j < m / 2; j++) {
-                auto t = omega * data[k + j + (m/2)];
-                auto u = data[k + j];
-                data[k + j] = u + t;
-                data[k + j + (m/2)] = u - t;
-                omega = omega * omega_m;
-            }
-        }
+        pool.parallel_for(chunks, [&](size_t c) {
+            auto first = c * chunk_sz;
+            auto last = std::min(n_butterflies, first + chunk_sz);
+            plan.butterflies(data, i, first, last);
+        });
     }
-#endif
 }
 
 /*
@@ -145,6 +540,9 @@ static int _fft_ct_recur(size_t count, cfval_t *data) {
         data[i + count/2] = even[i] - t;
     }
 
+    delete[] even;
+    delete[] odd;
+
     return 0;
 }
 
@@ -162,28 +560,34 @@ int FFTCooleyTukeyRecursive::fft(size_t count, cfval_t *input, cfval_t *output)
  * Cooley-Tukey split-problem recursive
  */
 std::string FFTCooleyTukeySplitRecursive::ident() {
-    return "ct_spl_rec";
+    return this->slow_join ? "ct_spl_rec_slow" : "ct_spl_rec";
 }
 
 int FFTCooleyTukeySplitRecursive::fft(size_t count, cfval_t *input, cfval_t *output) {
     const auto split_pow = 2;
 
-    auto split = split_problem(count, input, split_pow);
+    auto &plan = this->plan_for(count);
+    /* Too few points to split, run the whole transform directly */
+    if ((count >> split_pow) < 2) {
+        return plan.execute(count, input, output);
+    }
+    if (split_problem_natural(plan, count, input, output, split_pow)) {
+        return -1;
+    }
 
-    auto base_split_sz = split[0].size();
+    auto base_split_sz = count >> split_pow;
 
     /* Sequential for testing */
-    for (auto i = 0; i < split.size(); i++) {
-        _fft_ct_recur(base_split_sz, split[i].data());
+    for (auto i = 0; i < (1 << split_pow); i++) {
+        _fft_ct_recur(base_split_sz, output + (i * base_split_sz));
     }
 
-    /* Copy partially solved to output */
-    for(auto i = 0; i < split.size(); i++) {
-        std::memcpy(output + (i * base_split_sz), split[i].data(), base_split_sz * sizeof(cfval_t));
+    if (this->slow_join) {
+        join_problem_slow(count, output, split_pow);
+    } else {
+        join_problem(plan, count, output, split_pow);
     }
 
-    join_problem(count, output, split_pow);
-
     return 0;
 }
 
@@ -191,36 +595,142 @@ int FFTCooleyTukeySplitRecursive::fft(size_t count, cfval_t *input, cfval_t *out
 /*
  * Cooley-Tukey iterative
  */
-std::string FFTCooleyTukeyIterative::ident() {
-    return "ct_iter";
+template <typename T>
+std::string FFTCooleyTukeyIterativeT<T>::ident() {
+    return std::is_same<T, fval_t>::value ? "ct_iter" : "ct_iter " + fft_type_name<T>::get();
 }
 
-static int _fft_ct_iter(size_t count, cfval_t *input, cfval_t *output) {
-    if (bit_reverse_iterative(count, input, output)) {
+template <typename T>
+static int _fft_ct_iter(const FFTPlanT<T> &plan, size_t count, std::complex<T> *input, std::complex<T> *output) {
+    if (plan.execute(count, input, output)) {
         std::cerr << "Could not reverse bits!" << std::endl;
         return -1;
     }
+    return 0;
+}
+
+template <typename T>
+int FFTCooleyTukeyIterativeT<T>::fft(size_t count, sample_t *input, sample_t *output) {
+    return _fft_ct_iter(this->plan_for(count), count, input, output);
+}
+
+template class FFTCooleyTukeyIterativeT<float>;
+template class FFTCooleyTukeyIterativeT<double>;
+template class FFTCooleyTukeyIterativeT<long double>;
+#if FFT_HAVE_FLOAT16
+template class FFTCooleyTukeyIterativeT<_Float16>;
+#endif
+
+
+/*
+ * Cooley-Tukey radix-4 iterative
+ */
+std::string FFTCooleyTukeyRadix4Iterative::ident() {
+    return "ct_r4_iter";
+}
+
+static int _fft_ct_r4_iter(const FFTPlan &plan, size_t count, const cfval_t *input, cfval_t *output) {
+    if (!plan.supports(count)) {
+        return -1;
+    }
+
+    plan.bit_reverse(count, input, output);
+
+    auto log2_count = (unsigned)__builtin_ctzl(count);
+    size_t q = 1;
+
+    /* Odd powers of two need a single radix-2 stage first, after which every
+     * remaining pair of radix-2 stages is fused into one radix-4 stage */
+    if (log2_count & 1) {
+        plan.stages(count, output, 1, 1);
+        q = 2;
+    }
 
-    for (auto i = 1; i <= __builtin_ctz(count); i++) {
-        auto m = 1 << i;
-        auto cv = std::complex<fval_t>(0, -2. * M_PI / m);
-        auto omega_m = std::exp(cv);
-        for (auto k = 0; k < count; k += m) {
-            auto omega = std::complex<fval_t>(1., 0);
-            for (auto j = 0; j < m / 2; j++) {
-                auto t = omega * output[k + j + (m/2)];
-                auto u = output[k + j];
-                output[k + j] = u + t;
-                output[k + j + (m/2)] = u - t;
-                omega = omega * omega_m;
+    for (; q < count; q *= 4) {
+        auto m = q * 4;
+        auto tw = plan.stage4_twiddles(m);
+        for (size_t k = 0; k < count; k += m) {
+            for (size_t j = 0; j < q; j++) {
+                /* After bit-reversal the four sub-transforms of residue
+                 * 0, 2, 1, 3 (mod 4) sit at k, k+q, k+2q and k+3q */
+                auto t0 = output[k + j];
+                auto t2 = tw[3 * j + 1] * output[k + q + j];
+                auto t1 = tw[3 * j]     * output[k + 2 * q + j];
+                auto t3 = tw[3 * j + 2] * output[k + 3 * q + j];
+
+                auto a0 = t0 + t2;
+                auto a1 = t0 - t2;
+                auto b0 = t1 + t3;
+                auto b1 = mul_neg_i(t1 - t3);
+
+                output[k + j]         = a0 + b0;
+                output[k + q + j]     = a1 + b1;
+                output[k + 2 * q + j] = a0 - b0;
+                output[k + 3 * q + j] = a1 - b1;
             }
         }
     }
+
     return 0;
 }
 
-int FFTCooleyTukeyIterative::fft(size_t count, cfval_t *input, cfval_t *output) {
-    _fft_ct_iter(count, input, output);
+int FFTCooleyTukeyRadix4Iterative::fft(size_t count, cfval_t *input, cfval_t *output) {
+    return _fft_ct_r4_iter(this->plan_for(count), count, input, output);
+}
+
+
+/*
+ * Split-radix recursive
+ */
+std::string FFTSplitRadixRecursive::ident() {
+    return "sr_recur";
+}
+
+/* Out-of-place split-radix: one half-size transform of the even samples and
+ * two quarter-size transforms of the 4n+1 and 4n+3 samples, read directly from
+ * the strided input so no reordering pass is needed */
+static void _fft_sr_recur(const FFTPlan &plan, size_t count, const cfval_t *input, size_t stride, cfval_t *output) {
+    if (count == 1) {
+        output[0] = input[0];
+        return;
+    }
+    if (count == 2) {
+        output[0] = input[0] + input[stride];
+        output[1] = input[0] - input[stride];
+        return;
+    }
+
+    auto half = count / 2;
+    auto quarter = count / 4;
+
+    _fft_sr_recur(plan, half, input, stride * 2, output);
+    _fft_sr_recur(plan, quarter, input + stride, stride * 4, output + half);
+    _fft_sr_recur(plan, quarter, input + stride * 3, stride * 4, output + half + quarter);
+
+    auto tw = plan.stage4_twiddles(count);
+    for (size_t k = 0; k < quarter; k++) {
+        auto z1 = tw[3 * k]     * output[half + k];
+        auto z3 = tw[3 * k + 2] * output[half + quarter + k];
+
+        auto u0 = output[k];
+        auto u1 = output[quarter + k];
+        auto sum = z1 + z3;
+        auto diff = mul_neg_i(z1 - z3);
+
+        output[k]                  = u0 + sum;
+        output[half + k]           = u0 - sum;
+        output[quarter + k]        = u1 + diff;
+        output[half + quarter + k] = u1 - diff;
+    }
+}
+
+int FFTSplitRadixRecursive::fft(size_t count, cfval_t *input, cfval_t *output) {
+    auto &plan = this->plan_for(count);
+    if (!plan.supports(count)) {
+        return -1;
+    }
+
+    _fft_sr_recur(plan, count, input, 1, output);
 
     return 0;
 }
@@ -236,15 +746,21 @@ std::string FFTCooleyTukeySplitIterative::ident() {
 int FFTCooleyTukeySplitIterative::fft(size_t count, cfval_t *input, cfval_t *output) {
     const auto split_pow = 2;
 
-    auto split = split_problem(count, input, split_pow);
+    auto &plan = this->plan_for(count);
+    if ((count >> split_pow) < 2) {
+        return plan.execute(count, input, output);
+    }
+    if (split_problem(plan, count, input, output, split_pow)) {
+        return -1;
+    }
 
-    auto base_split_sz = split[0].size();
+    auto base_split_sz = count >> split_pow;
 
-    for (auto i = 0; i < split.size(); i++) {
-        _fft_ct_iter(base_split_sz, split[i].data(), output + (i * base_split_sz));
+    for (auto i = 0; i < (1 << split_pow); i++) {
+        plan.stages(base_split_sz, output + (i * base_split_sz), 1, __builtin_ctzl(base_split_sz));
     }
 
-    join_problem(count, output, split_pow);
+    join_problem(plan, count, output, split_pow);
 
     return 0;
 }
@@ -253,7 +769,8 @@ int FFTCooleyTukeySplitIterative::fft(size_t count, cfval_t *input, cfval_t *out
 /*
  * Cooley-Tukey multi-threaded iterative
  */
-FFTCooleyTukeyMultithreadedIterative::FFTCooleyTukeyMultithreadedIterative(unsigned split_pow) {
+FFTCooleyTukeyMultithreadedIterative::FFTCooleyTukeyMultithreadedIterative(ThreadPool &pool, unsigned split_pow) :
+pool(pool) {
     this->split_pow = split_pow;
 }
 
@@ -264,21 +781,38 @@ std::string FFTCooleyTukeyMultithreadedIterative::ident() {
 }
 
 int FFTCooleyTukeyMultithreadedIterative::fft(size_t count, cfval_t *input, cfval_t *output) {
-    auto split = split_problem(count, input, this->split_pow);
+    auto &plan = this->plan_for(count);
+    if ((count >> this->split_pow) < 2) {
+        return plan.execute(count, input, output);
+    }
+    if (split_problem(plan, count, input, output, this->split_pow)) {
+        return -1;
+    }
 
-    auto base_split_sz = split[0].size();
+    auto base_split_sz = count >> this->split_pow;
 
-    std::vector<std::thread> threads;
+    /* Sub-problems are queued on the persistent pool, idle workers steal
+     * whatever is left over */
+    this->pool.parallel_for(1 << this->split_pow, [&](size_t i) {
+        plan.stages(base_split_sz, output + (i * base_split_sz), 1, __builtin_ctzl(base_split_sz));
+    });
 
-    for (auto i = 0; i < split.size(); i++) {
-        threads.emplace_back(std::thread(_fft_ct_iter, base_split_sz, split[i].data(), output + (i * base_split_sz)));
-    }
+    join_problem_parallel(this->pool, plan, count, output, split_pow);
+
+    return 0;
+}
 
-    for (auto &t : threads) {
-        t.join();
+/* Whole transforms are independent, so a batch is spread one transform per
+ * task rather than splitting each transform */
+int FFTCooleyTukeyMultithreadedIterative::fft_batch(size_t count, size_t batch, size_t stride, cfval_t *input, cfval_t *output) {
+    auto &plan = this->plan_for(count);
+    if (!plan.supports(count)) {
+        return -1;
     }
 
-    join_problem(count, output, split_pow);
+    this->pool.parallel_for(batch, [&](size_t b) {
+        plan.execute(count, input + b * stride, output + b * stride);
+    });
 
     return 0;
 }
@@ -297,42 +831,43 @@ std::string FFTCooleyTukeySYCLIterative::ident() {
     return base;
 }
 
-/* std::complex is not fully supported in SYCL and will not work on GPU targets */
-cfval_t cust_exp(cfval_t val) {
-    fval_t exp_real = std::exp(val.real());
-    return std::complex(exp_real * std::cos(val.imag()), exp_real * std::sin(val.imag()));
-}
-
 int FFTCooleyTukeySYCLIterative::fft(size_t count, cfval_t *input, cfval_t *output) {
-    auto split = split_problem(count, input, this->split_pow);
-
-    auto base_split_sz = split[0].size();
+    auto &plan = this->plan_for(count);
+    if ((count >> this->split_pow) < 2) {
+        return plan.execute(count, input, output);
+    }
+    if (split_problem(plan, count, input, output, this->split_pow)) {
+        return -1;
+    }
 
-    sycl::buffer<cfval_t> out_buff{output, sycl::range{count}};
-    sycl::buffer<cfval_t> in_buff{input, sycl::range{count}};
+    size_t split = 1 << this->split_pow;
+    auto base_split_sz = count >> this->split_pow;
 
     try {
+        /* Buffers are scoped to this block so the result is written back to
+         * `output` before the host-side join touches it */
+        sycl::buffer<cfval_t> out_buff{output, sycl::range{count}};
+        /* Stage-packed twiddles from the plan, see FFTPlan */
+        sycl::buffer<cfval_t> tw_buff{plan.stage_twiddles(2), sycl::range{count - 1}};
+
         this->queue.submit([&](auto &h) {
             sycl::accessor out_acc{out_buff, h, sycl::read_write};
-            sycl::accessor in_acc{in_buff, h, sycl::read_only};
+            sycl::accessor tw_acc{tw_buff, h, sycl::read_only};
 
-            h.parallel_for(sycl::range{split.size()}, [=](sycl::id<1> idx) {
+            /* The split has already left every sub-problem bit-reversed in
+             * place, only the butterfly stages run here */
+            h.parallel_for(sycl::range{split}, [=](sycl::id<1> idx) {
                 auto base = idx * base_split_sz;
 
-                bit_reverse_iterative(base_split_sz, &in_acc[base], &out_acc[base]);
-
                 for (auto i = 1; i <= __builtin_ctz(base_split_sz); i++) {
                     auto m = 1 << i;
-                    auto cv = std::complex<fval_t>(0, -2. * M_PI / m);
-                    auto omega_m = cust_exp(cv);
+                    auto tw_base = m / 2 - 1;
                     for (auto k = 0; k < base_split_sz; k += m) {
-                        auto omega = std::complex<fval_t>(1., 0);
                         for (auto j = 0; j < m / 2; j++) {
-                            auto t = omega * out_acc[base + k + j + (m/2)];
+                            auto t = tw_acc[tw_base + j] * out_acc[base + k + j + (m/2)];
                             auto u = out_acc[base + k + j];
                             out_acc[base + k + j] = u + t;
                             out_acc[base + k + j + (m/2)] = u - t;
-                            omega = omega * omega_m;
                         }
                     }
                 }
@@ -345,9 +880,62 @@ int FFTCooleyTukeySYCLIterative::fft(size_t count, cfval_t *input, cfval_t *outp
         return -1;
     }
 
+    join_problem(plan, count, output, split_pow);
 
+    return 0;
+}
+
+
+/* One submission and one wait for the whole batch, each work-item runs a
+ * complete transform */
+int FFTCooleyTukeySYCLIterative::fft_batch(size_t count, size_t batch, size_t stride, cfval_t *input, cfval_t *output) {
+    auto &plan = this->plan_for(count);
+    if (!plan.supports(count) || (count < 2) || (batch == 0)) {
+        return -1;
+    }
+
+    auto log2_count = __builtin_ctzl(count);
+    auto total = (batch - 1) * stride + count;
+
+    try {
+        sycl::buffer<cfval_t> in_buff{(const cfval_t *)input, sycl::range{total}};
+        sycl::buffer<cfval_t> out_buff{output, sycl::range{total}};
+        sycl::buffer<uint32_t> rev_buff{plan.bit_reverse_table(), sycl::range{count}};
+        sycl::buffer<cfval_t> tw_buff{plan.stage_twiddles(2), sycl::range{count - 1}};
+
+        this->queue.submit([&](auto &h) {
+            sycl::accessor in_acc{in_buff, h, sycl::read_only};
+            sycl::accessor out_acc{out_buff, h, sycl::read_write};
+            sycl::accessor rev_acc{rev_buff, h, sycl::read_only};
+            sycl::accessor tw_acc{tw_buff, h, sycl::read_only};
+
+            h.parallel_for(sycl::range{batch}, [=](sycl::id<1> idx) {
+                auto base = idx * stride;
+
+                for (auto i = 0; i < count; i++) {
+                    out_acc[base + rev_acc[i]] = in_acc[base + i];
+                }
 
-    join_problem(count, output, split_pow);
+                for (auto i = 1; i <= log2_count; i++) {
+                    auto m = 1 << i;
+                    auto tw_base = m / 2 - 1;
+                    for (auto k = 0; k < count; k += m) {
+                        for (auto j = 0; j < m / 2; j++) {
+                            auto t = tw_acc[tw_base + j] * out_acc[base + k + j + (m/2)];
+                            auto u = out_acc[base + k + j];
+                            out_acc[base + k + j] = u + t;
+                            out_acc[base + k + j + (m/2)] = u - t;
+                        }
+                    }
+                }
+            });
+        }).wait();
+
+        this->queue.throw_asynchronous();
+    } catch (const sycl::exception &e) {
+        std::cout << "Exception caught: " << e.what() << std::endl;
+        return -1;
+    }
 
     return 0;
 }
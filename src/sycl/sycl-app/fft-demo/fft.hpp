@@ -2,24 +2,166 @@
 #define FFT_HPP
 
 #include <complex>
+#include <cstdint>
+#include <memory>
 #include <string>
 #include <sycl/sycl.hpp>
+#include <vector>
+
+#include "common/bench.hpp"
+#include "common/thread_pool.hpp"
 
 typedef float fval_t;
 typedef std::complex<fval_t> cfval_t;
 
-void gen_data(size_t count, cfval_t *data);
+#if defined(__FLT16_MANT_DIG__) && !defined(__SYCL_DEVICE_ONLY__)
+#  define FFT_HAVE_FLOAT16 1
+#else
+#  define FFT_HAVE_FLOAT16 0
+#endif
+
+/* Name of a sample type, for the idents of providers not on fval_t */
+template <typename T> struct fft_type_name;
+template <> struct fft_type_name<float> { static std::string get() { return "float"; } };
+template <> struct fft_type_name<double> { static std::string get() { return "double"; } };
+template <> struct fft_type_name<long double> { static std::string get() { return "long double"; } };
+#if FFT_HAVE_FLOAT16
+template <> struct fft_type_name<_Float16> { static std::string get() { return "_Float16"; } };
+#endif
+
+template <typename T>
+void gen_data(size_t count, std::complex<T> *data);
+
+/*
+ * Precomputed tables for power-of-two transforms, built once per size and
+ * reused across calls. A plan for `count` points also serves every smaller
+ * power of two: the per-stage twiddle tables don't depend on the transform
+ * size, and the bit-reversal permutation for count >> s is the full one
+ * shifted right by s.
+ *
+ * The plan, FFTProviderT and FFTCooleyTukeyIterativeT are templates over the
+ * sample type, instantiated for float, double, long double and _Float16 where
+ * the compiler has it. Everything else runs on fval_t through the FFTPlan and
+ * FFTProvider names.
+ */
+template <typename T>
+class FFTPlanT {
+public:
+    typedef std::complex<T> sample_t;
+
+private:
+    size_t count;
+    unsigned log2_count;
+
+    /* Bit-reversal permutation of [0, count) */
+    std::vector<uint32_t> rev;
+
+    /* Stage-packed twiddles: the stage of length m stores W_m^j for j < m/2
+     * contiguously at offset m/2 - 1. Each entry is evaluated directly in
+     * long double, so the error does not grow with the stage length */
+    std::vector<sample_t> twiddles;
+
+    /* Radix-4 twiddles: the stage of length m stores (W_m^j, W_m^2j, W_m^3j)
+     * for j < m/4 contiguously at offset 3 * (m/4 - 1) */
+    std::vector<sample_t> twiddles4;
+
+public:
+    FFTPlanT(size_t count);
+
+    size_t size() const { return this->count; }
+    unsigned log2_size() const { return this->log2_count; }
+
+    /* Check that a transform of `n` points can be run with this plan */
+    bool supports(size_t n) const;
+
+    const uint32_t *bit_reverse_table() const { return this->rev.data(); }
+    const sample_t *stage_twiddles(size_t m) const { return &this->twiddles[m / 2 - 1]; }
+    const sample_t *stage4_twiddles(size_t m) const { return &this->twiddles4[3 * (m / 4 - 1)]; }
+
+    /* Index that element `idx` of an `n` point transform is moved to */
+    size_t reverse(size_t idx, size_t n) const {
+        return this->rev[idx] >> (this->log2_count - __builtin_ctzl(n));
+    }
+
+    void bit_reverse(size_t n, const sample_t *input, sample_t *output) const;
+
+    /* Run butterfly stages first..last (stage i has length 2^i) in place */
+    void stages(size_t n, sample_t *data, unsigned first, unsigned last) const;
+
+    /* Run butterflies [first, last) of one stage, numbering the n/2
+     * butterflies of the stage in memory order. Disjoint ranges can run
+     * concurrently */
+    void butterflies(sample_t *data, unsigned stage, size_t first, size_t last) const;
+
+    /* Full out-of-place radix-2 transform, -1 if `n` is not supported */
+    int execute(size_t n, const sample_t *input, sample_t *output) const;
+};
+
+typedef FFTPlanT<fval_t> FFTPlan;
+
+template <typename T>
+class FFTProviderT {
+public:
+    typedef std::complex<T> sample_t;
+
+private:
+    /* W_count^k for k < count/2, for packing real transforms */
+    std::vector<sample_t> real_twiddles;
+    /* Working buffer for the inverse transforms */
+    std::vector<sample_t> scratch;
+
+    void real_twiddles_for(size_t count);
+
+protected:
+    std::unique_ptr<FFTPlanT<T>> plan;
+
+    /* Get a plan that supports `count` points, only rebuilding on size change */
+    const FFTPlanT<T> &plan_for(size_t count);
 
-class FFTProvider {
 public:
-    virtual int fft(size_t count, cfval_t *input, cfval_t *output) = 0;
+    virtual ~FFTProviderT() = default;
+
+    virtual int fft(size_t count, sample_t *input, sample_t *output) = 0;
+
+    /* Run `batch` independent transforms of `count` points each, transform b
+     * reading from input + b * stride and writing to output + b * stride.
+     * Providers that can amortise launch or hand-off costs over many
+     * transforms override this, the default runs them one at a time */
+    virtual int fft_batch(size_t count, size_t batch, size_t stride, sample_t *input, sample_t *output);
+
+    /* Inverse transform built on fft(), scaled by 1/count so that
+     * ifft(fft(x)) == x */
+    int ifft(size_t count, const sample_t *input, sample_t *output);
+
+    /* Transform `count` real samples (a power of two) into the count/2 + 1
+     * non-redundant bins. The samples are packed in pairs into a count/2 point
+     * complex fft() followed by one pass that splits the even and odd
+     * spectra, roughly halving the work and memory of a complex transform */
+    int rfft(size_t count, const T *input, sample_t *output);
+
+    /* Inverse of rfft(), from count/2 + 1 bins back to `count` real samples */
+    int irfft(size_t count, const sample_t *input, T *output);
 
     virtual std::string ident() = 0;
 
-    /* Get the average number of FFTs per second */
-    float benchmark(size_t count, size_t n_points);
+    /* Get the average number of FFTs per second, and optionally the number of
+     * heap allocations made per FFT */
+    float benchmark(size_t count, size_t n_points, float *allocs_per_fft = nullptr);
+    /* Per-FFT time distribution through the shared harness, with heap
+     * allocations per FFT over the timed samples */
+    BenchStats measure(const BenchOptions &opts, size_t n_points, float *allocs_per_fft = nullptr);
+
+    /* Get the average number of FFTs per second when run `batch` at a time */
+    float benchmark_batch(size_t count, size_t n_points, size_t batch);
+    /* Time distribution of one call transforming `batch` at a time */
+    BenchStats measure_batch(const BenchOptions &opts, size_t n_points, size_t batch);
+
+    /* Per-transform time distribution of real-input FFTs (rfft) */
+    BenchStats measure_real(const BenchOptions &opts, size_t n_points);
 };
 
+typedef FFTProviderT<fval_t> FFTProvider;
+
 class FFTCooleyTukeyRecursive : public FFTProvider {
 public:
     virtual std::string ident();
@@ -27,12 +169,110 @@ public:
 };
 
 class FFTCooleyTukeySplitRecursive : public FFTProvider {
+private:
+    /* Join the sub-transforms with the original per-element std::exp
+     * butterflies rather than the plan's stages, kept as a cross-check */
+    bool slow_join;
+
+public:
+    FFTCooleyTukeySplitRecursive(bool slow_join = false) : slow_join(slow_join) {}
+
+    virtual std::string ident();
+    int fft(size_t count, cfval_t *input, cfval_t *output);
+};
+
+template <typename T>
+class FFTCooleyTukeyIterativeT : public FFTProviderT<T> {
+public:
+    typedef typename FFTProviderT<T>::sample_t sample_t;
+
+    virtual std::string ident();
+    int fft(size_t count, sample_t *input, sample_t *output);
+};
+
+typedef FFTCooleyTukeyIterativeT<fval_t> FFTCooleyTukeyIterative;
+
+class FFTCooleyTukeyRadix4Iterative : public FFTProvider {
+public:
+    virtual std::string ident();
+    int fft(size_t count, cfval_t *input, cfval_t *output);
+};
+
+class FFTSplitRadixRecursive : public FFTProvider {
+public:
+    virtual std::string ident();
+    int fft(size_t count, cfval_t *input, cfval_t *output);
+};
+
+/* Instruction sets usable by FFTCooleyTukeySIMDIterative */
+enum class FFTSimdIsa {
+    Auto,
+    Scalar,
+    SSE,
+    AVX2,
+    AVX512,
+};
+
+class FFTCooleyTukeySIMDIterative : public FFTProvider {
+private:
+    FFTSimdIsa isa;
+
+    /* Split real/imaginary (SoA) working storage and twiddles */
+    std::vector<fval_t> re, im;
+    std::vector<fval_t> tw_re, tw_im;
+    size_t tw_count = 0;
+
+public:
+    /* Requesting an ISA the CPU lacks falls back to the best one available */
+    FFTCooleyTukeySIMDIterative(FFTSimdIsa isa = FFTSimdIsa::Auto);
+
+    /* Best ISA supported by the running CPU */
+    static FFTSimdIsa detect();
+
+    virtual std::string ident();
+    int fft(size_t count, cfval_t *input, cfval_t *output);
+};
+
+/*
+ * Arbitrary-length transform by chirp-z (Bluestein): the DFT is rewritten as a
+ * convolution with a chirp and evaluated with power-of-two FFTs of at least
+ * 2 * count - 1 points. Works for any size, including primes.
+ */
+class FFTBluestein : public FFTProvider {
+private:
+    size_t count = 0;
+    size_t conv_count = 0;
+
+    /* c[n] = exp(-i pi n^2 / count) */
+    std::vector<cfval_t> chirp;
+    /* Transform of the conjugate chirp filter, pre-scaled by 1/conv_count */
+    std::vector<cfval_t> filter;
+    std::vector<cfval_t> work;
+    std::vector<cfval_t> work2;
+
+    void prepare(size_t count);
+
 public:
     virtual std::string ident();
     int fft(size_t count, cfval_t *input, cfval_t *output);
 };
 
-class FFTCooleyTukeyIterative : public FFTProvider {
+/*
+ * Arbitrary-length mixed-radix transform for sizes made of factors 2, 3, 5
+ * and 7 (radix-4 is used where possible). Sizes with any other prime factor
+ * fall back to FFTBluestein.
+ */
+class FFTMixedRadix : public FFTProvider {
+private:
+    size_t count = 0;
+    std::vector<size_t> factors;
+    /* W_count^j for j < count */
+    std::vector<cfval_t> twiddles;
+    bool use_bluestein = false;
+    FFTBluestein bluestein;
+
+    void prepare(size_t count);
+
 public:
     virtual std::string ident();
     int fft(size_t count, cfval_t *input, cfval_t *output);
@@ -46,10 +286,44 @@ public:
 
 class FFTCooleyTukeyMultithreadedIterative : public FFTProvider {
 private:
+    ThreadPool &pool;
     unsigned split_pow;
 
 public:
-    FFTCooleyTukeyMultithreadedIterative(unsigned split_pow);
+    /* Sub-problems run on `pool`, which is shared and not owned */
+    FFTCooleyTukeyMultithreadedIterative(ThreadPool &pool, unsigned split_pow);
+    virtual std::string ident();
+    int fft(size_t count, cfval_t *input, cfval_t *output);
+    int fft_batch(size_t count, size_t batch, size_t stride, cfval_t *input, cfval_t *output);
+};
+
+/*
+ * Four-step (Bailey) transform for sizes beyond cache: the N = N1 * N2 points
+ * are treated as an N1 x N2 matrix so every sub-transform is of N1 or N2
+ * points and stays in cache. The rest is one twiddle pass and three tiled
+ * transposes, everything spread across the pool.
+ */
+class FFTFourStep : public FFTProvider {
+private:
+    ThreadPool &pool;
+
+    size_t count = 0;
+    size_t n1 = 0;
+    size_t n2 = 0;
+
+    /* W_N^e = tw_hi[e / N1] * tw_lo[e % N1] for e < N */
+    std::vector<cfval_t> tw_lo;
+    std::vector<cfval_t> tw_hi;
+
+    std::vector<cfval_t> work;
+    std::vector<cfval_t> work2;
+
+    void prepare(size_t count);
+    void rows_pass(const FFTPlan &plan, size_t rows, size_t len, const cfval_t *input, cfval_t *output, bool twiddle);
+    void transpose_pass(size_t rows, size_t cols, const cfval_t *input, cfval_t *output);
+
+public:
+    FFTFourStep(ThreadPool &pool);
     virtual std::string ident();
     int fft(size_t count, cfval_t *input, cfval_t *output);
 };
@@ -63,6 +337,67 @@ public:
     FFTCooleyTukeySYCLIterative(sycl::queue &queue, unsigned split_pow);
     virtual std::string ident();
     int fft(size_t count, cfval_t *input, cfval_t *output);
+    int fft_batch(size_t count, size_t batch, size_t stride, cfval_t *input, cfval_t *output);
+};
+
+/*
+ * Fully device-resident SYCL transform. Plan tables and working buffers are
+ * USM device allocations kept for as long as the size does not change, and
+ * all work (bit-reversal and every butterfly stage) runs as kernels on a
+ * kept-alive in-order queue. Host work per call is the input and output copy,
+ * skipped when the caller passes USM pointers.
+ */
+class FFTCooleyTukeySYCLUSMIterative : public FFTProvider {
+protected:
+    sycl::queue queue;
+
+    /* Transform size of the tables, and number of transforms the working
+     * buffers have room for */
+    size_t count = 0;
+    size_t batch = 0;
+    cfval_t *dev_in = nullptr;
+    cfval_t *dev_out = nullptr;
+    cfval_t *dev_tw = nullptr;
+    uint32_t *dev_rev = nullptr;
+
+    void release();
+    int prepare(size_t count, size_t batch = 1);
+
+public:
+    /* Runs on the device and context of `queue` */
+    FFTCooleyTukeySYCLUSMIterative(sycl::queue &queue);
+    ~FFTCooleyTukeySYCLUSMIterative();
+
+    virtual std::string ident();
+    int fft(size_t count, cfval_t *input, cfval_t *output);
+
+    /* Per-transform time distribution with input and output already in USM
+     * device memory */
+    BenchStats measure_device(const BenchOptions &opts, size_t n_points);
+};
+
+/*
+ * Work-group cooperative SYCL transform on the same device-resident storage.
+ * Each work-group loads one transform, or one block of it for sizes beyond
+ * local memory, into local memory and runs its stages there between group
+ * barriers. Batches launch one work-group per transform (or block) in a single
+ * nd_range kernel, so the device sees thousands of work-items instead of one
+ * per sub-problem.
+ */
+class FFTCooleyTukeySYCLLocalIterative : public FFTCooleyTukeySYCLUSMIterative {
+private:
+    /* Points per work-group block and work-items per work-group */
+    size_t local_max;
+    size_t wg_size;
+
+    void enqueue(size_t count, size_t batch, const cfval_t *src, size_t src_stride, cfval_t *dst, size_t dst_stride);
+
+public:
+    FFTCooleyTukeySYCLLocalIterative(sycl::queue &queue);
+
+    virtual std::string ident();
+    int fft(size_t count, cfval_t *input, cfval_t *output);
+    int fft_batch(size_t count, size_t batch, size_t stride, cfval_t *input, cfval_t *output);
 };
 
 #endif
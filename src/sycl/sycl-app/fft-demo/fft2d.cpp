@@ -0,0 +1,231 @@
+#include "fft2d.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <iostream>
+
+/* Host transpose tile edge, 32 x 32 complex floats is 8 KiB per side */
+#define TRANSPOSE_TILE 32
+
+/* Device transpose tile edge, one work-item per element */
+#define TRANSPOSE_TILE_SYCL 16
+
+void transpose_tiled(size_t rows, size_t cols, const cfval_t *input, cfval_t *output,
+                     size_t row_begin, size_t row_end) {
+    for (size_t r0 = row_begin; r0 < row_end; r0 += TRANSPOSE_TILE) {
+        auto r1 = std::min<size_t>(r0 + TRANSPOSE_TILE, row_end);
+        for (size_t c0 = 0; c0 < cols; c0 += TRANSPOSE_TILE) {
+            auto c1 = std::min<size_t>(c0 + TRANSPOSE_TILE, cols);
+            for (auto r = r0; r < r1; r++) {
+                for (auto c = c0; c < c1; c++) {
+                    output[c * rows + r] = input[r * cols + c];
+                }
+            }
+        }
+    }
+}
+
+BenchStats FFT2DProvider::measure(const BenchOptions &opts, size_t rows, size_t cols) {
+    std::vector<cfval_t> xt_data(rows * cols);
+    std::vector<cfval_t> xf_data(rows * cols);
+    for (size_t i = 0; i < xt_data.size(); i++) {
+        xt_data[i] = cfval_t((fval_t)((i * 7919) % 1024) / 512.0f - 1.0f, 0);
+    }
+
+    if (this->fft2d(rows, cols, xt_data.data(), xf_data.data())) {
+        return BenchStats();
+    }
+
+    return bench_measure_calls(opts, [&]() {
+        return this->fft2d(rows, cols, xt_data.data(), xf_data.data());
+    });
+}
+
+
+/*
+ * Row-column
+ */
+FFT2DRowColumn::FFT2DRowColumn(FFTProvider &provider) : provider(provider) {
+}
+
+std::string FFT2DRowColumn::ident() {
+    return "rc " + this->provider.ident();
+}
+
+int FFT2DRowColumn::fft2d(size_t rows, size_t cols, cfval_t *input, cfval_t *output) {
+    auto points = rows * cols;
+    if (this->work.size() < points) {
+        this->work.resize(points);
+        this->work2.resize(points);
+    }
+    auto work = this->work.data();
+    auto work2 = this->work2.data();
+
+    if (this->provider.fft_batch(cols, rows, cols, input, work)) {
+        return -1;
+    }
+    transpose_tiled(rows, cols, work, work2, 0, rows);
+    if (this->provider.fft_batch(rows, cols, rows, work2, work)) {
+        return -1;
+    }
+    transpose_tiled(cols, rows, work, output, 0, cols);
+
+    return 0;
+}
+
+
+/*
+ * Parallel row-column
+ */
+FFT2DParallel::FFT2DParallel(ThreadPool &pool) : pool(pool) {
+    for (size_t i = 0; i < this->pool.concurrency(); i++) {
+        this->providers.emplace_back(new FFTCooleyTukeySIMDIterative());
+    }
+}
+
+std::string FFT2DParallel::ident() {
+    return "rc_mt " + std::to_string(this->pool.concurrency());
+}
+
+int FFT2DParallel::rows_pass(size_t rows, size_t cols, cfval_t *input, cfval_t *output) {
+    /* One contiguous range of rows per thread, each task owns its provider */
+    auto n_tasks = std::min(rows, this->providers.size());
+    std::atomic<int> res{0};
+
+    this->pool.parallel_for(n_tasks, [&](size_t t) {
+        auto first = rows * t / n_tasks;
+        auto last = rows * (t + 1) / n_tasks;
+        if (this->providers[t]->fft_batch(cols, last - first, cols, input + first * cols, output + first * cols)) {
+            res = -1;
+        }
+    });
+
+    return res;
+}
+
+void FFT2DParallel::transpose_pass(size_t rows, size_t cols, const cfval_t *input, cfval_t *output) {
+    auto n_stripes = (rows + TRANSPOSE_TILE - 1) / TRANSPOSE_TILE;
+
+    this->pool.parallel_for(n_stripes, [&](size_t s) {
+        auto first = s * TRANSPOSE_TILE;
+        transpose_tiled(rows, cols, input, output, first, std::min<size_t>(first + TRANSPOSE_TILE, rows));
+    });
+}
+
+int FFT2DParallel::fft2d(size_t rows, size_t cols, cfval_t *input, cfval_t *output) {
+    auto points = rows * cols;
+    if (this->work.size() < points) {
+        this->work.resize(points);
+        this->work2.resize(points);
+    }
+    auto work = this->work.data();
+    auto work2 = this->work2.data();
+
+    if (this->rows_pass(rows, cols, input, work)) {
+        return -1;
+    }
+    this->transpose_pass(rows, cols, work, work2);
+    if (this->rows_pass(cols, rows, work2, work)) {
+        return -1;
+    }
+    this->transpose_pass(cols, rows, work, output);
+
+    return 0;
+}
+
+
+/*
+ * SYCL row-column
+ */
+FFT2DSYCL::FFT2DSYCL(sycl::queue &queue) :
+queue(queue.get_context(), queue.get_device(), sycl::property_list{sycl::property::queue::in_order()}),
+row_fft(queue), col_fft(queue) {
+}
+
+FFT2DSYCL::~FFT2DSYCL() {
+    this->release();
+}
+
+std::string FFT2DSYCL::ident() {
+    return "rc_sycl_wg";
+}
+
+void FFT2DSYCL::release() {
+    for (void *ptr : {(void *)this->dev_a, (void *)this->dev_b}) {
+        if (ptr) {
+            sycl::free(ptr, this->queue);
+        }
+    }
+    this->dev_a = nullptr;
+    this->dev_b = nullptr;
+    this->points = 0;
+}
+
+void FFT2DSYCL::transpose(size_t rows, size_t cols, const cfval_t *input, cfval_t *output) {
+    const size_t T = TRANSPOSE_TILE_SYCL;
+    auto g_rows = (rows + T - 1) / T * T;
+    auto g_cols = (cols + T - 1) / T * T;
+
+    this->queue.submit([&](sycl::handler &h) {
+        /* Padded by one column so the transposed reads avoid bank conflicts */
+        sycl::local_accessor<cfval_t, 1> tile{sycl::range<1>(T * (T + 1)), h};
+
+        h.parallel_for(sycl::nd_range<2>{sycl::range<2>(g_rows, g_cols), sycl::range<2>(T, T)},
+                       [=](sycl::nd_item<2> it) {
+            auto lr = it.get_local_id(0);
+            auto lc = it.get_local_id(1);
+            auto r0 = it.get_group(0) * T;
+            auto c0 = it.get_group(1) * T;
+
+            if ((r0 + lr < rows) && (c0 + lc < cols)) {
+                tile[lr * (T + 1) + lc] = input[(r0 + lr) * cols + c0 + lc];
+            }
+            sycl::group_barrier(it.get_group());
+
+            /* Work-item (lr, lc) writes element (c0 + lr, r0 + lc) of the
+             * output, so consecutive work-items write consecutive addresses */
+            if ((c0 + lr < cols) && (r0 + lc < rows)) {
+                output[(c0 + lr) * rows + r0 + lc] = tile[lc * (T + 1) + lr];
+            }
+        });
+    });
+}
+
+int FFT2DSYCL::fft2d(size_t rows, size_t cols, cfval_t *input, cfval_t *output) {
+    auto points = rows * cols;
+
+    try {
+        if (this->points < points) {
+            this->release();
+            this->dev_a = sycl::malloc_device<cfval_t>(points, this->queue);
+            this->dev_b = sycl::malloc_device<cfval_t>(points, this->queue);
+            if (!this->dev_a || !this->dev_b) {
+                this->release();
+                return -1;
+            }
+            this->points = points;
+        }
+
+        this->queue.memcpy(this->dev_a, input, points * sizeof(cfval_t)).wait();
+
+        /* The 1D batches run on their own queues and return once complete */
+        if (this->row_fft.fft_batch(cols, rows, cols, this->dev_a, this->dev_b)) {
+            return -1;
+        }
+        this->transpose(rows, cols, this->dev_b, this->dev_a);
+        this->queue.wait_and_throw();
+
+        if (this->col_fft.fft_batch(rows, cols, rows, this->dev_a, this->dev_b)) {
+            return -1;
+        }
+        this->transpose(cols, rows, this->dev_b, this->dev_a);
+
+        this->queue.memcpy(output, this->dev_a, points * sizeof(cfval_t));
+        this->queue.wait_and_throw();
+    } catch (const sycl::exception &e) {
+        std::cout << "Exception caught: " << e.what() << std::endl;
+        return -1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,93 @@
+#ifndef FFT2D_HPP
+#define FFT2D_HPP
+
+#include <memory>
+#include <string>
+#include <sycl/sycl.hpp>
+#include <vector>
+
+#include "fft.hpp"
+#include "common/thread_pool.hpp"
+
+/* Transpose the row-major `rows` x `cols` matrix `input` into the `cols` x
+ * `rows` matrix `output`, for input rows [row_begin, row_end). Works in square
+ * tiles so both sides stay in cache */
+void transpose_tiled(size_t rows, size_t cols, const cfval_t *input, cfval_t *output,
+                     size_t row_begin, size_t row_end);
+
+/*
+ * 2D transforms
+ *
+ * All providers take row-major `rows` x `cols` data and use row-column
+ * decomposition: transform every row, transpose, transform every former
+ * column as a row, transpose back. Both sizes must suit the 1D transform used.
+ */
+class FFT2DProvider {
+public:
+    virtual ~FFT2DProvider() {}
+
+    virtual int fft2d(size_t rows, size_t cols, cfval_t *input, cfval_t *output) = 0;
+    virtual std::string ident() = 0;
+
+    /* Per-transform time distribution */
+    BenchStats measure(const BenchOptions &opts, size_t rows, size_t cols);
+};
+
+/* Single-threaded, on any 1D provider */
+class FFT2DRowColumn : public FFT2DProvider {
+private:
+    FFTProvider &provider;
+    std::vector<cfval_t> work;
+    std::vector<cfval_t> work2;
+
+public:
+    FFT2DRowColumn(FFTProvider &provider);
+
+    virtual std::string ident();
+    int fft2d(size_t rows, size_t cols, cfval_t *input, cfval_t *output);
+};
+
+/* Rows, columns and transposes split across a thread pool, with one SIMD 1D
+ * provider per thread */
+class FFT2DParallel : public FFT2DProvider {
+private:
+    ThreadPool &pool;
+    std::vector<std::unique_ptr<FFTProvider>> providers;
+    std::vector<cfval_t> work;
+    std::vector<cfval_t> work2;
+
+    int rows_pass(size_t rows, size_t cols, cfval_t *input, cfval_t *output);
+    void transpose_pass(size_t rows, size_t cols, const cfval_t *input, cfval_t *output);
+
+public:
+    FFT2DParallel(ThreadPool &pool);
+
+    virtual std::string ident();
+    int fft2d(size_t rows, size_t cols, cfval_t *input, cfval_t *output);
+};
+
+/* Device-resident: both passes run as work-group batches and the transposes
+ * as tiled local-memory kernels, the data only crosses to the device once
+ * each way */
+class FFT2DSYCL : public FFT2DProvider {
+private:
+    sycl::queue queue;
+    FFTCooleyTukeySYCLLocalIterative row_fft;
+    FFTCooleyTukeySYCLLocalIterative col_fft;
+
+    size_t points = 0;
+    cfval_t *dev_a = nullptr;
+    cfval_t *dev_b = nullptr;
+
+    void release();
+    void transpose(size_t rows, size_t cols, const cfval_t *input, cfval_t *output);
+
+public:
+    FFT2DSYCL(sycl::queue &queue);
+    ~FFT2DSYCL();
+
+    virtual std::string ident();
+    int fft2d(size_t rows, size_t cols, cfval_t *input, cfval_t *output);
+};
+
+#endif
@@ -0,0 +1,75 @@
+#include "fft_dispatch.hpp"
+
+#include <algorithm>
+
+/*
+ * Size-dispatched transform
+ */
+
+/* Each calibration sample runs about CALIBRATE_POINTS points, and at least
+ * CALIBRATE_MIN_REPEAT transforms or batches */
+#define CALIBRATE_POINTS (1 << 16)
+#define CALIBRATE_MIN_REPEAT 2
+
+FFTDispatch::FFTDispatch(FFTProvider *host, FFTProvider *device, SyclDispatch &dispatch, size_t dev) :
+host(host), device(device), dispatch(dispatch), dev(dev) {
+}
+
+std::string FFTDispatch::ident() {
+    if (!this->forced) {
+        return "dispatch";
+    }
+    if (this->forced_at == SyclDispatch::NEVER) {
+        return "dispatch host";
+    }
+    if (this->forced_at == 0) {
+        return "dispatch device";
+    }
+    return "dispatch " + std::to_string(this->forced_at);
+}
+
+void FFTDispatch::calibrate(const std::vector<size_t> &sizes, size_t batch_max, size_t batch_points) {
+    /* Nanoseconds per transform from a provider's rate, 0 when it failed */
+    auto per_fft = [](float rate) {
+        return (rate > 0) ? 1e9 / rate : -1.0;
+    };
+
+    auto single = [&](FFTProvider *provider) {
+        return [=](size_t n_points) {
+            auto count = std::max<size_t>(CALIBRATE_MIN_REPEAT, CALIBRATE_POINTS / n_points);
+            return per_fft(provider->benchmark(count, n_points));
+        };
+    };
+    this->single_op = this->dispatch.calibrate("fft", this->dev, sizes, single(this->host), single(this->device));
+
+    auto batched = [&](FFTProvider *provider) {
+        return [=](size_t n_points) {
+            auto batch = std::max<size_t>(1, std::min<size_t>(batch_max, batch_points / n_points));
+            auto count = std::max<size_t>(CALIBRATE_MIN_REPEAT, CALIBRATE_POINTS / (n_points * batch));
+            return per_fft(provider->benchmark_batch(count, n_points, batch));
+        };
+    };
+    this->batch_op = this->dispatch.calibrate("fft_batch", this->dev, sizes, batched(this->host), batched(this->device));
+}
+
+void FFTDispatch::force(size_t crossover) {
+    this->single_op = this->dispatch.fixed("fft", this->dev, crossover);
+    this->batch_op = this->dispatch.fixed("fft_batch", this->dev, crossover);
+    this->forced = true;
+    this->forced_at = crossover;
+}
+
+FFTProvider *FFTDispatch::provider_for(size_t op, size_t count) {
+    if ((op != SyclDispatch::NEVER) && this->dispatch.on_device(op, count)) {
+        return this->device;
+    }
+    return this->host;
+}
+
+int FFTDispatch::fft(size_t count, cfval_t *input, cfval_t *output) {
+    return this->provider_for(this->single_op, count)->fft(count, input, output);
+}
+
+int FFTDispatch::fft_batch(size_t count, size_t batch, size_t stride, cfval_t *input, cfval_t *output) {
+    return this->provider_for(this->batch_op, count)->fft_batch(count, batch, stride, input, output);
+}
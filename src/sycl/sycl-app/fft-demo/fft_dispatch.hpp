@@ -0,0 +1,52 @@
+#ifndef FFT_DISPATCH_HPP
+#define FFT_DISPATCH_HPP
+
+#include <string>
+#include <vector>
+
+#include "common/dispatch.hpp"
+#include "fft.hpp"
+
+/*
+ * Size-dispatched transform
+ *
+ * Single and batched transforms below their calibrated crossover run inline
+ * on the host provider, from it on the device provider, which takes a batch
+ * in one launch. Neither provider is owned.
+ */
+class FFTDispatch : public FFTProvider {
+private:
+    FFTProvider *host;
+    FFTProvider *device;
+    SyclDispatch &dispatch;
+    size_t dev;
+
+    /* SyclDispatch handles, NEVER until calibrated */
+    size_t single_op = SyclDispatch::NEVER;
+    size_t batch_op = SyclDispatch::NEVER;
+
+    /* Crossover given to force(), if it was called */
+    bool forced = false;
+    size_t forced_at = SyclDispatch::NEVER;
+
+    FFTProvider *provider_for(size_t op, size_t count);
+
+public:
+    /* `dev` is the index `device` runs on in `dispatch` */
+    FFTDispatch(FFTProvider *host, FFTProvider *device, SyclDispatch &dispatch, size_t dev);
+
+    /* Find the crossovers of single transforms and of batches of up to
+     * `batch_max` transforms and `batch_points` points, over ascending sizes */
+    void calibrate(const std::vector<size_t> &sizes, size_t batch_max, size_t batch_points);
+
+    /* Use `crossover` for single and batched transforms instead of
+     * calibrating, so each side can be checked on its own. The ident then
+     * names the side, "dispatch host" for NEVER and "dispatch device" for 0 */
+    void force(size_t crossover);
+
+    virtual std::string ident();
+    int fft(size_t count, cfval_t *input, cfval_t *output);
+    int fft_batch(size_t count, size_t batch, size_t stride, cfval_t *input, cfval_t *output);
+};
+
+#endif
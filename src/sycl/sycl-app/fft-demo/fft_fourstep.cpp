@@ -0,0 +1,121 @@
+#include "fft.hpp"
+#include "fft2d.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <string>
+
+/*
+ * Four-step
+ *
+ * With n = N2 * n1 + n2 and k = k1 + N1 * k2:
+ *   1. transpose the N1 x N2 input to N2 x N1
+ *   2. N2 transforms of N1 points, each row n2 then scaled by W_N^(n2 * k1)
+ *   3. transpose to N1 x N2
+ *   4. N1 transforms of N2 points
+ *   5. transpose to N2 x N1, which is X in natural order
+ */
+
+/* Below 2^FOURSTEP_MIN_POW points the whole transform fits in cache and runs
+ * directly */
+#define FOURSTEP_MIN_POW 12
+
+/* Tasks per pool thread for the row passes, for load balance */
+#define FOURSTEP_TASKS_PER_THREAD 4
+
+/* Rows per transpose task */
+#define FOURSTEP_TRANSPOSE_ROWS 32
+
+FFTFourStep::FFTFourStep(ThreadPool &pool) : pool(pool) {
+}
+
+std::string FFTFourStep::ident() {
+    return "four_step " + std::to_string(this->pool.concurrency());
+}
+
+void FFTFourStep::prepare(size_t count) {
+    if (this->count == count) {
+        return;
+    }
+
+    auto log2_count = __builtin_ctzl(count);
+    this->n1 = (size_t)1 << (log2_count / 2);
+    this->n2 = count / this->n1;
+
+    this->tw_lo.resize(this->n1);
+    for (size_t b = 0; b < this->n1; b++) {
+        auto angle = -2. * M_PI * (double)b / (double)count;
+        this->tw_lo[b] = cfval_t((fval_t)std::cos(angle), (fval_t)std::sin(angle));
+    }
+    this->tw_hi.resize(this->n2);
+    for (size_t a = 0; a < this->n2; a++) {
+        auto angle = -2. * M_PI * (double)a / (double)this->n2;
+        this->tw_hi[a] = cfval_t((fval_t)std::cos(angle), (fval_t)std::sin(angle));
+    }
+
+    this->work.resize(count);
+    this->work2.resize(count);
+    this->count = count;
+}
+
+void FFTFourStep::rows_pass(const FFTPlan &plan, size_t rows, size_t len, const cfval_t *input, cfval_t *output, bool twiddle) {
+    auto n_tasks = std::min(rows, this->pool.concurrency() * FOURSTEP_TASKS_PER_THREAD);
+    auto n1_mask = this->n1 - 1;
+    auto log2_n1 = __builtin_ctzl(this->n1);
+    auto tw_lo = this->tw_lo.data();
+    auto tw_hi = this->tw_hi.data();
+
+    this->pool.parallel_for(n_tasks, [&](size_t t) {
+        auto first = rows * t / n_tasks;
+        auto last = rows * (t + 1) / n_tasks;
+        for (auto r = first; r < last; r++) {
+            auto out = output + r * len;
+            plan.execute(len, input + r * len, out);
+            if (twiddle) {
+                for (size_t k = 1; k < len; k++) {
+                    auto e = r * k;
+                    auto hi = tw_hi[e >> log2_n1];
+                    auto lo = tw_lo[e & n1_mask];
+                    auto wr = hi.real() * lo.real() - hi.imag() * lo.imag();
+                    auto wi = hi.real() * lo.imag() + hi.imag() * lo.real();
+                    auto v = out[k];
+                    out[k] = cfval_t(v.real() * wr - v.imag() * wi, v.real() * wi + v.imag() * wr);
+                }
+            }
+        }
+    });
+}
+
+void FFTFourStep::transpose_pass(size_t rows, size_t cols, const cfval_t *input, cfval_t *output) {
+    auto n_stripes = (rows + FOURSTEP_TRANSPOSE_ROWS - 1) / FOURSTEP_TRANSPOSE_ROWS;
+
+    this->pool.parallel_for(n_stripes, [&](size_t s) {
+        auto first = s * FOURSTEP_TRANSPOSE_ROWS;
+        transpose_tiled(rows, cols, input, output, first, std::min<size_t>(first + FOURSTEP_TRANSPOSE_ROWS, rows));
+    });
+}
+
+int FFTFourStep::fft(size_t count, cfval_t *input, cfval_t *output) {
+    if ((count < 2) || (count & (count - 1))) {
+        return -1;
+    }
+
+    if (count < ((size_t)1 << FOURSTEP_MIN_POW)) {
+        return this->plan_for(count).execute(count, input, output);
+    }
+
+    this->prepare(count);
+
+    /* One plan for the larger factor serves both */
+    auto &plan = this->plan_for(this->n2);
+    auto a = this->work.data();
+    auto b = this->work2.data();
+
+    this->transpose_pass(this->n1, this->n2, input, a);
+    this->rows_pass(plan, this->n2, this->n1, a, b, true);
+    this->transpose_pass(this->n2, this->n1, b, a);
+    this->rows_pass(plan, this->n1, this->n2, a, b, false);
+    this->transpose_pass(this->n1, this->n2, b, output);
+
+    return 0;
+}
@@ -0,0 +1,269 @@
+#include "fft.hpp"
+
+#include <cmath>
+#include <complex>
+#include <string>
+#include <vector>
+
+/* Largest radix with a butterfly below */
+#define MIXED_MAX_RADIX 7
+
+static cfval_t twiddle(size_t k, size_t n) {
+    auto angle = -2. * M_PI * (double)k / (double)n;
+    return cfval_t((fval_t)std::cos(angle), (fval_t)std::sin(angle));
+}
+
+/*
+ * Mixed-radix
+ */
+std::string FFTMixedRadix::ident() {
+    return "mixed_radix";
+}
+
+void FFTMixedRadix::prepare(size_t count) {
+    if (this->count == count) {
+        return;
+    }
+
+    this->count = count;
+    this->factors.clear();
+
+    auto rem = count;
+    for (auto radix : {4, 2, 3, 5, 7}) {
+        while ((rem % radix) == 0) {
+            this->factors.push_back(radix);
+            rem /= radix;
+        }
+    }
+
+    this->use_bluestein = (rem != 1);
+    if (this->use_bluestein) {
+        this->twiddles.clear();
+        return;
+    }
+
+    this->twiddles.resize(count);
+    for (size_t j = 0; j < count; j++) {
+        this->twiddles[j] = twiddle(j, count);
+    }
+}
+
+/* Length-p DFT of t[], writing out[s * out_stride]. `tw` is the full W_N table
+ * and `tw_step` = N / p, so W_p^k = tw[k * tw_step] */
+static inline void dft_small(size_t p, const cfval_t *t, cfval_t *out, size_t out_stride,
+                             const cfval_t *tw, size_t tw_step) {
+    switch (p) {
+    case 2:
+        out[0] = t[0] + t[1];
+        out[out_stride] = t[0] - t[1];
+        break;
+    case 3: {
+        /* W_3 = -1/2 - i sqrt(3)/2 */
+        const fval_t s3 = (fval_t)0.86602540378443864676;
+        auto a = t[1] + t[2];
+        auto b = t[1] - t[2];
+        auto c = t[0] - a * (fval_t)0.5;
+        auto d = cfval_t(b.imag() * s3, -b.real() * s3);
+        out[0] = t[0] + a;
+        out[out_stride] = c + d;
+        out[2 * out_stride] = c - d;
+        break;
+    }
+    case 4: {
+        auto a0 = t[0] + t[2];
+        auto a1 = t[0] - t[2];
+        auto b0 = t[1] + t[3];
+        auto b1 = t[1] - t[3];
+        /* b1 * -i */
+        auto b1i = cfval_t(b1.imag(), -b1.real());
+        out[0] = a0 + b0;
+        out[out_stride] = a1 + b1i;
+        out[2 * out_stride] = a0 - b0;
+        out[3 * out_stride] = a1 - b1i;
+        break;
+    }
+    case 5: {
+        const fval_t c1 = (fval_t)0.30901699437494742410;  /* cos(2 pi / 5) */
+        const fval_t c2 = (fval_t)-0.80901699437494742410; /* cos(4 pi / 5) */
+        const fval_t s1 = (fval_t)0.95105651629515357212;  /* sin(2 pi / 5) */
+        const fval_t s2 = (fval_t)0.58778525229247312917;  /* sin(4 pi / 5) */
+        auto a1 = t[1] + t[4];
+        auto b1 = t[1] - t[4];
+        auto a2 = t[2] + t[3];
+        auto b2 = t[2] - t[3];
+        auto r1 = t[0] + a1 * c1 + a2 * c2;
+        auto r2 = t[0] + a1 * c2 + a2 * c1;
+        /* -i * (...) */
+        auto i1 = b1 * s1 + b2 * s2;
+        auto i2 = b1 * s2 - b2 * s1;
+        auto j1 = cfval_t(i1.imag(), -i1.real());
+        auto j2 = cfval_t(i2.imag(), -i2.real());
+        out[0] = t[0] + a1 + a2;
+        out[out_stride] = r1 + j1;
+        out[2 * out_stride] = r2 + j2;
+        out[3 * out_stride] = r2 - j2;
+        out[4 * out_stride] = r1 - j1;
+        break;
+    }
+    default:
+        /* Radix 7, W_p^(r s) is stepped through without a modulo */
+        for (size_t s = 0; s < p; s++) {
+            auto acc = t[0];
+            size_t idx = 0;
+            for (size_t r = 1; r < p; r++) {
+                idx += s;
+                if (idx >= p) {
+                    idx -= p;
+                }
+                acc += t[r] * tw[idx * tw_step];
+            }
+            out[s * out_stride] = acc;
+        }
+        break;
+    }
+}
+
+/* Decimation in time: the n points read from `input` with `stride` are
+ * transformed into contiguous `output`. The p sub-transforms of every p-th
+ * sample are computed recursively into output[r * m], then combined in place
+ * with X[k + m s] = sum_r W_n^(r k) W_p^(r s) Y_r[k] */
+static void _fft_mixed_recur(const cfval_t *tw, size_t N, const size_t *factors, size_t n,
+                             const cfval_t *input, size_t stride, cfval_t *output) {
+    auto p = factors[0];
+    auto m = n / p;
+    cfval_t t[MIXED_MAX_RADIX];
+
+    if (m == 1) {
+        for (size_t r = 0; r < p; r++) {
+            t[r] = input[r * stride];
+        }
+        dft_small(p, t, output, 1, tw, N / p);
+        return;
+    }
+
+    for (size_t r = 0; r < p; r++) {
+        _fft_mixed_recur(tw, N, factors + 1, m, input + r * stride, stride * p, output + r * m);
+    }
+
+    auto tw_step = N / n;
+    for (size_t k = 0; k < m; k++) {
+        t[0] = output[k];
+        for (size_t r = 1; r < p; r++) {
+            t[r] = tw[r * k * tw_step] * output[r * m + k];
+        }
+        dft_small(p, t, output + k, m, tw, N / p);
+    }
+}
+
+int FFTMixedRadix::fft(size_t count, cfval_t *input, cfval_t *output) {
+    if (count == 0) {
+        return -1;
+    }
+    if (count == 1) {
+        output[0] = input[0];
+        return 0;
+    }
+
+    this->prepare(count);
+
+    if (this->use_bluestein) {
+        return this->bluestein.fft(count, input, output);
+    }
+
+    _fft_mixed_recur(this->twiddles.data(), count, this->factors.data(), count, input, 1, output);
+
+    return 0;
+}
+
+
+/*
+ * Bluestein
+ */
+std::string FFTBluestein::ident() {
+    return "bluestein";
+}
+
+/*
+ * With nk = (n^2 + k^2 - (k - n)^2) / 2 the DFT becomes
+ *     X[k] = c[k] sum_n (x[n] c[n]) conj(c[k - n])
+ * a linear convolution of x c with conj(c), done with zero-padded power-of-two
+ * transforms. The filter side only depends on the size so it is cached.
+ */
+void FFTBluestein::prepare(size_t count) {
+    if (this->count == count) {
+        return;
+    }
+
+    this->count = count;
+    this->conv_count = 1;
+    while (this->conv_count < 2 * count - 1) {
+        this->conv_count <<= 1;
+    }
+    auto M = this->conv_count;
+
+    this->chirp.resize(count);
+    for (size_t n = 0; n < count; n++) {
+        /* n^2 mod 2N keeps the angle small and exact in double precision */
+        auto sq = (unsigned long long)n * n % (2ull * count);
+        auto angle = -M_PI * (double)sq / (double)count;
+        this->chirp[n] = cfval_t((fval_t)std::cos(angle), (fval_t)std::sin(angle));
+    }
+
+    this->work.assign(M, cfval_t(0, 0));
+    this->work2.resize(M);
+    this->filter.resize(M);
+
+    auto &plan = this->plan_for(M);
+
+    this->work[0] = std::conj(this->chirp[0]);
+    for (size_t n = 1; n < count; n++) {
+        this->work[n] = std::conj(this->chirp[n]);
+        this->work[M - n] = std::conj(this->chirp[n]);
+    }
+    plan.execute(M, this->work.data(), this->filter.data());
+
+    auto scale = (fval_t)1 / (fval_t)M;
+    for (auto &f : this->filter) {
+        f *= scale;
+    }
+}
+
+int FFTBluestein::fft(size_t count, cfval_t *input, cfval_t *output) {
+    if (count == 0) {
+        return -1;
+    }
+    if (count == 1) {
+        output[0] = input[0];
+        return 0;
+    }
+
+    this->prepare(count);
+
+    auto M = this->conv_count;
+    auto &plan = this->plan_for(M);
+    auto a = this->work.data();
+    auto b = this->work2.data();
+
+    for (size_t n = 0; n < count; n++) {
+        a[n] = input[n] * this->chirp[n];
+    }
+    for (size_t n = count; n < M; n++) {
+        a[n] = cfval_t(0, 0);
+    }
+
+    plan.execute(M, a, b);
+
+    /* Pointwise product, conjugated so the forward transform below acts as the
+     * inverse (the 1/M scale is folded into the filter) */
+    for (size_t k = 0; k < M; k++) {
+        a[k] = std::conj(b[k] * this->filter[k]);
+    }
+
+    plan.execute(M, a, b);
+
+    for (size_t k = 0; k < count; k++) {
+        output[k] = this->chirp[k] * std::conj(b[k]);
+    }
+
+    return 0;
+}
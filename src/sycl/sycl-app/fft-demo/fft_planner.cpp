@@ -0,0 +1,172 @@
+#include "fft_planner.hpp"
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+/*
+ * Measuring planner
+ */
+
+/* Each candidate is timed over about TUNE_POINTS points, and at least
+ * TUNE_MIN_REPEAT transforms */
+#define TUNE_POINTS (1 << 21)
+#define TUNE_MIN_REPEAT 2
+
+/* Range of split_pow tried for the split providers */
+#define TUNE_SPLIT_MIN 2
+#define TUNE_SPLIT_MAX 5
+
+FFTPlanner::FFTPlanner(const std::string &wisdom_path, ThreadPool &pool, sycl::queue *queue) :
+pool(pool), wisdom_path(wisdom_path) {
+    this->add(new FFTCooleyTukeyIterative());
+    this->add(new FFTCooleyTukeySIMDIterative());
+    this->add(new FFTCooleyTukeyRadix4Iterative());
+    this->add(new FFTSplitRadixRecursive());
+    for (unsigned s = TUNE_SPLIT_MIN; s <= TUNE_SPLIT_MAX; s++) {
+        this->add(new FFTCooleyTukeyMultithreadedIterative(this->pool, s), (size_t)2 << s);
+    }
+    this->add(new FFTFourStep(this->pool));
+
+    std::string device = "none";
+    if (queue) {
+        for (unsigned s = 3; s <= 4; s++) {
+            this->add(new FFTCooleyTukeySYCLIterative(*queue, s), (size_t)2 << s);
+        }
+        this->add(new FFTCooleyTukeySYCLUSMIterative(*queue));
+        this->add(new FFTCooleyTukeySYCLLocalIterative(*queue));
+        device = queue->get_device().get_info<sycl::info::device::name>();
+    }
+
+    /* Wisdom only applies to the same thread count and device */
+    std::ostringstream header;
+    header << "# fft-demo wisdom 1 threads=" << this->pool.concurrency()
+           << " device=" << device;
+    this->wisdom_header = header.str();
+
+    this->load_wisdom();
+}
+
+std::string FFTPlanner::ident() {
+    return "tuned";
+}
+
+void FFTPlanner::add(FFTProvider *provider, size_t min_count) {
+    Candidate c;
+    c.name = provider->ident();
+    c.provider.reset(provider);
+    c.min_count = min_count;
+    this->candidates.push_back(std::move(c));
+}
+
+int FFTPlanner::load_wisdom() {
+    if (this->wisdom_path.empty()) {
+        return -1;
+    }
+
+    std::ifstream file(this->wisdom_path);
+    std::string line;
+    if (!file || !std::getline(file, line) || (line != this->wisdom_header)) {
+        return -1;
+    }
+
+    /* "<count> <provider ident>" per line, unknown providers are skipped */
+    while (std::getline(file, line)) {
+        std::istringstream fields(line);
+        size_t count;
+        std::string name;
+        if (!(fields >> count) || !std::getline(fields >> std::ws, name)) {
+            continue;
+        }
+        for (auto &c : this->candidates) {
+            if ((c.name == name) && (count >= c.min_count)) {
+                this->chosen[count] = &c;
+                break;
+            }
+        }
+    }
+
+    return 0;
+}
+
+int FFTPlanner::save_wisdom() {
+    if (this->wisdom_path.empty()) {
+        return -1;
+    }
+
+    std::ofstream file(this->wisdom_path, std::ios::trunc);
+    if (!file) {
+        return -1;
+    }
+
+    file << this->wisdom_header << std::endl;
+    for (auto &entry : this->chosen) {
+        file << entry.first << " " << entry.second->name << std::endl;
+    }
+
+    return file ? 0 : -1;
+}
+
+FFTPlanner::Candidate *FFTPlanner::tune(size_t count) {
+    /* Every candidate is power-of-two only */
+    if ((count < 2) || (count & (count - 1))) {
+        return nullptr;
+    }
+
+    auto repeat = std::max<size_t>(TUNE_MIN_REPEAT, TUNE_POINTS / count);
+
+    Candidate *best = nullptr;
+    float best_rate = 0;
+    for (auto &c : this->candidates) {
+        if (count < c.min_count) {
+            continue;
+        }
+        /* A failed run reports a rate of 0 and is never picked */
+        auto rate = c.provider->benchmark(repeat, count);
+        if (rate > best_rate) {
+            best_rate = rate;
+            best = &c;
+        }
+    }
+
+    return best;
+}
+
+FFTPlanner::Candidate *FFTPlanner::candidate_for(size_t count) {
+    auto it = this->chosen.find(count);
+    if (it != this->chosen.end()) {
+        return it->second;
+    }
+
+    auto best = this->tune(count);
+    if (best) {
+        this->chosen[count] = best;
+        if (this->save_wisdom() && !this->wisdom_path.empty()) {
+            std::cerr << "Failed to write wisdom to " << this->wisdom_path << std::endl;
+        }
+    }
+
+    return best;
+}
+
+int FFTPlanner::fft(size_t count, cfval_t *input, cfval_t *output) {
+    auto c = this->candidate_for(count);
+    if (!c) {
+        return -1;
+    }
+    return c->provider->fft(count, input, output);
+}
+
+int FFTPlanner::fft_batch(size_t count, size_t batch, size_t stride, cfval_t *input, cfval_t *output) {
+    auto c = this->candidate_for(count);
+    if (!c) {
+        return -1;
+    }
+    return c->provider->fft_batch(count, batch, stride, input, output);
+}
+
+std::string FFTPlanner::choice(size_t count) {
+    auto c = this->candidate_for(count);
+    return c ? c->name : "none";
+}
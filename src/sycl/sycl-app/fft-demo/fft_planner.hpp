@@ -0,0 +1,59 @@
+#ifndef FFT_PLANNER_HPP
+#define FFT_PLANNER_HPP
+
+#include <map>
+#include <memory>
+#include <string>
+#include <sycl/sycl.hpp>
+#include <vector>
+
+#include "fft.hpp"
+
+/*
+ * Measuring planner
+ *
+ * The first transform of each size times every candidate provider and
+ * parameter (split_pow for the split providers) and keeps the fastest, like
+ * FFTW's measure mode. Winners are written to a wisdom file keyed by the
+ * host's core count and SYCL device, so later runs on the same machine load
+ * them and skip tuning.
+ */
+class FFTPlanner : public FFTProvider {
+private:
+    struct Candidate {
+        std::unique_ptr<FFTProvider> provider;
+        std::string name;
+        /* Smallest size the provider handles */
+        size_t min_count;
+    };
+
+    ThreadPool &pool;
+    std::vector<Candidate> candidates;
+    std::map<size_t, Candidate *> chosen;
+
+    std::string wisdom_path;
+    std::string wisdom_header;
+
+    void add(FFTProvider *provider, size_t min_count = 2);
+    Candidate *tune(size_t count);
+    Candidate *candidate_for(size_t count);
+
+    int load_wisdom();
+    int save_wisdom();
+
+public:
+    /* An empty `wisdom_path` tunes every run without touching the disk. The
+     * multithreaded candidates all run on `pool`, the process' shared pool,
+     * and differ only in split_pow. SYCL candidates are only considered with
+     * a queue */
+    FFTPlanner(const std::string &wisdom_path, ThreadPool &pool, sycl::queue *queue = nullptr);
+
+    virtual std::string ident();
+    int fft(size_t count, cfval_t *input, cfval_t *output);
+    int fft_batch(size_t count, size_t batch, size_t stride, cfval_t *input, cfval_t *output);
+
+    /* Provider picked for `count` points, tuning first if needed */
+    std::string choice(size_t count);
+};
+
+#endif
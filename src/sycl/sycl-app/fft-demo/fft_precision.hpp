@@ -0,0 +1,265 @@
+#ifndef FFT_PRECISION_HPP
+#define FFT_PRECISION_HPP
+
+#include <algorithm>
+#include <cmath>
+#include <complex>
+#include <cstdint>
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include "fft.hpp"
+
+/*
+ * Precision comparison
+ *
+ * Floating-point types run through FFTCooleyTukeyIterativeT, the same plan and
+ * radix-2 transform as the fval_t providers. Fixed point, Q15/Q31 with block
+ * floating-point scaling as used on the FPGA/ARM targets, has its own
+ * butterflies below on the tables of a double plan.
+ *
+ * Fixed-point samples are plain {re, im} pairs rather than std::complex, which
+ * is only specified for the standard floating-point types.
+ */
+template <typename T>
+struct cpx_t {
+    T re;
+    T im;
+};
+
+template <> struct fft_type_name<int16_t> { static std::string get() { return "q15"; } };
+template <> struct fft_type_name<int32_t> { static std::string get() { return "q31"; } };
+
+/* Relative RMS error against long double that --verify accepts per sample
+ * type, a few times what each reaches at 2^16 points */
+template <typename S> struct precision_bound;
+template <> struct precision_bound<std::complex<float>> { static constexpr double rms = 1e-6; };
+template <> struct precision_bound<std::complex<double>> { static constexpr double rms = 1e-14; };
+#if FFT_HAVE_FLOAT16
+template <> struct precision_bound<std::complex<_Float16>> { static constexpr double rms = 5e-3; };
+#endif
+template <> struct precision_bound<cpx_t<int16_t>> { static constexpr double rms = 5e-3; };
+template <> struct precision_bound<cpx_t<int32_t>> { static constexpr double rms = 1e-7; };
+
+/*
+ * Fixed point, Q15 (int16_t) or Q31 (int32_t) fractions in [-1, 1)
+ *
+ * Block floating point: before each stage the largest component is checked
+ * and the whole block is shifted right until it is below a quarter of full
+ * scale. A radix-2 butterfly grows a component by at most 1 + sqrt(2), so
+ * the stage cannot overflow. The shifts are summed into a block exponent,
+ * the true spectrum is output * 2^exponent().
+ */
+template <typename Q>
+class FFTFixedIterative {
+private:
+    static_assert(std::is_same<Q, int16_t>::value || std::is_same<Q, int32_t>::value,
+                  "fixed-point transforms are Q15 or Q31");
+
+    /* Wide enough for a product of two samples */
+    typedef typename std::conditional<sizeof(Q) == 2, int32_t, int64_t>::type acc_t;
+
+    static const int FRAC_BITS = sizeof(Q) * 8 - 1;
+    static const acc_t FULL_SCALE = ((acc_t)1 << FRAC_BITS) - 1;
+
+    int block_exp = 0;
+
+    /* Bit-reversal and twiddles come from a double plan, the twiddles
+     * rounded to Q format in the same stage-packed layout */
+    std::unique_ptr<FFTPlanT<double>> plan;
+    std::vector<cpx_t<Q>> twiddles;
+
+    void prepare(size_t count) {
+        if (this->plan && (this->plan->size() == count)) {
+            return;
+        }
+        this->plan = std::make_unique<FFTPlanT<double>>(count);
+        this->twiddles.resize(count - 1);
+        for (size_t m = 2; m <= count; m <<= 1) {
+            auto src = this->plan->stage_twiddles(m);
+            auto tw = &this->twiddles[m / 2 - 1];
+            for (size_t j = 0; j < m / 2; j++) {
+                tw[j] = {to_fixed(src[j].real()), to_fixed(src[j].imag())};
+            }
+        }
+    }
+
+    static Q to_fixed(double val) {
+        auto scaled = std::llround(val * (double)((acc_t)1 << FRAC_BITS));
+        if (scaled > (long long)FULL_SCALE) {
+            scaled = FULL_SCALE;
+        } else if (scaled < -(long long)FULL_SCALE - 1) {
+            scaled = -FULL_SCALE - 1;
+        }
+        return (Q)scaled;
+    }
+
+    /* Rounded Q-format product */
+    static acc_t mul(acc_t a, acc_t b) {
+        return (a * b + ((acc_t)1 << (FRAC_BITS - 1))) >> FRAC_BITS;
+    }
+
+    /* Rounded arithmetic right shift */
+    static Q shift(Q val, int s) {
+        return (Q)(((acc_t)val + ((acc_t)1 << (s - 1))) >> s);
+    }
+
+public:
+    typedef cpx_t<Q> sample_t;
+
+    std::string ident() { return "ct_iter " + fft_type_name<Q>::get(); }
+
+    int exponent() const { return this->block_exp; }
+
+    int fft(size_t count, const cpx_t<Q> *input, cpx_t<Q> *output) {
+        if ((count < 2) || (count & (count - 1))) {
+            return -1;
+        }
+        this->prepare(count);
+
+        auto rev = this->plan->bit_reverse_table();
+        for (size_t i = 0; i < count; i++) {
+            output[rev[i]] = input[i];
+        }
+
+        this->block_exp = 0;
+        for (size_t m = 2; m <= count; m <<= 1) {
+            acc_t peak = 0;
+            for (size_t i = 0; i < count; i++) {
+                peak = std::max(peak, std::max(std::abs((acc_t)output[i].re), std::abs((acc_t)output[i].im)));
+            }
+
+            int s = 0;
+            while ((peak >> s) >= (FULL_SCALE >> 2)) {
+                s++;
+            }
+            if (s) {
+                for (size_t i = 0; i < count; i++) {
+                    output[i] = {shift(output[i].re, s), shift(output[i].im, s)};
+                }
+                this->block_exp += s;
+            }
+
+            auto half = m / 2;
+            auto tw = &this->twiddles[half - 1];
+            for (size_t k = 0; k < count; k += m) {
+                for (size_t j = 0; j < half; j++) {
+                    auto &a = output[k + j];
+                    auto &b = output[k + j + half];
+                    auto tr = mul(tw[j].re, b.re) - mul(tw[j].im, b.im);
+                    auto ti = mul(tw[j].re, b.im) + mul(tw[j].im, b.re);
+                    b = {(Q)(a.re - tr), (Q)(a.im - ti)};
+                    a = {(Q)(a.re + tr), (Q)(a.im + ti)};
+                }
+            }
+        }
+
+        return 0;
+    }
+
+    /* Input must already be within [-1, 1) */
+    void load(size_t count, const std::complex<double> *input, cpx_t<Q> *output) {
+        for (size_t i = 0; i < count; i++) {
+            output[i] = {to_fixed(input[i].real()), to_fixed(input[i].imag())};
+        }
+    }
+
+    void store(size_t count, const cpx_t<Q> *input, std::complex<double> *output) {
+        auto scale = std::ldexp(1.0, this->block_exp - FRAC_BITS);
+        for (size_t i = 0; i < count; i++) {
+            output[i] = std::complex<double>(input[i].re * scale, input[i].im * scale);
+        }
+    }
+};
+
+/* Conversions between double-precision data and a transform's samples, the
+ * fixed-point transform does its own scaling */
+template <typename T>
+void precision_load(FFTProviderT<T> &, size_t count, const std::complex<double> *input, std::complex<T> *output) {
+    for (size_t i = 0; i < count; i++) {
+        output[i] = std::complex<T>((T)input[i].real(), (T)input[i].imag());
+    }
+}
+
+template <typename T>
+void precision_store(FFTProviderT<T> &, size_t count, const std::complex<T> *input, std::complex<double> *output) {
+    for (size_t i = 0; i < count; i++) {
+        output[i] = std::complex<double>((double)input[i].real(), (double)input[i].imag());
+    }
+}
+
+template <typename Q>
+void precision_load(FFTFixedIterative<Q> &fft, size_t count, const std::complex<double> *input, cpx_t<Q> *output) {
+    fft.load(count, input, output);
+}
+
+template <typename Q>
+void precision_store(FFTFixedIterative<Q> &fft, size_t count, const cpx_t<Q> *input, std::complex<double> *output) {
+    fft.store(count, input, output);
+}
+
+/* Per-transform time distribution of `n_points` point transforms */
+template <typename P>
+BenchStats measure_precision(const BenchOptions &opts, P &fft, size_t n_points) {
+    typedef typename P::sample_t S;
+    std::vector<std::complex<double>> data(n_points);
+    for (size_t i = 0; i < n_points; i++) {
+        data[i] = std::complex<double>(std::sin(0.1 * i), std::cos(0.37 * i)) * 0.5;
+    }
+    std::vector<S> xt_data(n_points);
+    std::vector<S> xf_data(n_points);
+    precision_load(fft, n_points, data.data(), xt_data.data());
+
+    if (fft.fft(n_points, xt_data.data(), xf_data.data())) {
+        return BenchStats();
+    }
+
+    return bench_measure_calls(opts, [&]() {
+        return fft.fft(n_points, xt_data.data(), xf_data.data());
+    });
+}
+
+/* Relative RMS error of an `n_points` transform of noise-like data in
+ * [-0.5, 0.5), against a long double transform of the same input */
+template <typename P>
+double error_precision(P &fft, size_t n_points) {
+    typedef typename P::sample_t S;
+    std::vector<std::complex<double>> data(n_points);
+    uint32_t seed = 12345;
+    for (size_t i = 0; i < n_points; i++) {
+        seed = seed * 1664525u + 1013904223u;
+        auto re = (double)(seed >> 8) / (double)(1 << 24) - 0.5;
+        seed = seed * 1664525u + 1013904223u;
+        auto im = (double)(seed >> 8) / (double)(1 << 24) - 0.5;
+        data[i] = std::complex<double>(re, im);
+    }
+
+    std::vector<S> xt_data(n_points);
+    std::vector<S> xf_data(n_points);
+    std::vector<std::complex<double>> result(n_points);
+    precision_load(fft, n_points, data.data(), xt_data.data());
+    if (fft.fft(n_points, xt_data.data(), xf_data.data())) {
+        return -1;
+    }
+    precision_store(fft, n_points, xf_data.data(), result.data());
+
+    FFTCooleyTukeyIterativeT<long double> ref;
+    std::vector<std::complex<long double>> ref_in(n_points);
+    std::vector<std::complex<long double>> ref_out(n_points);
+    precision_load(ref, n_points, data.data(), ref_in.data());
+    ref.fft(n_points, ref_in.data(), ref_out.data());
+
+    double err = 0, norm = 0;
+    for (size_t i = 0; i < n_points; i++) {
+        auto diff = std::complex<double>((double)ref_out[i].real(), (double)ref_out[i].imag()) - result[i];
+        err += std::norm(diff);
+        norm += (double)std::norm(ref_out[i]);
+    }
+
+    return std::sqrt(err / norm);
+}
+
+#endif
@@ -0,0 +1,226 @@
+#include "fft.hpp"
+
+#include <cstring>
+#include <string>
+#include <vector>
+
+/*
+ * Explicitly vectorized Cooley-Tukey iterative
+ *
+ * Data is kept as split real/imaginary arrays so a vector register holds W
+ * consecutive real (or imaginary) parts, and the twiddles come from the plan's
+ * tables so there is no serial omega dependency between lanes. Kernels are
+ * written once with GCC/Clang vector extensions and compiled per ISA through
+ * target attributes, the ISA is chosen at runtime.
+ */
+
+#if (defined(__x86_64__) || defined(__i386__)) && !defined(__SYCL_DEVICE_ONLY__)
+#  define FFT_SIMD_X86 1
+#else
+#  define FFT_SIMD_X86 0
+#endif
+
+typedef fval_t v4sf_t  __attribute__((vector_size(16)));
+typedef fval_t v8sf_t  __attribute__((vector_size(32)));
+typedef fval_t v16sf_t __attribute__((vector_size(64)));
+
+/* Scalar SoA butterflies, used for the stages narrower than a vector */
+static void _simd_stage_scalar(size_t count, size_t half, fval_t *re, fval_t *im,
+                               const fval_t *tw_re, const fval_t *tw_im) {
+    for (size_t k = 0; k < count; k += half * 2) {
+        for (size_t j = 0; j < half; j++) {
+            auto br = re[k + j + half];
+            auto bi = im[k + j + half];
+            auto tr = tw_re[j] * br - tw_im[j] * bi;
+            auto ti = tw_re[j] * bi + tw_im[j] * br;
+            auto ur = re[k + j];
+            auto ui = im[k + j];
+            re[k + j] = ur + tr;
+            im[k + j] = ui + ti;
+            re[k + j + half] = ur - tr;
+            im[k + j + half] = ui - ti;
+        }
+    }
+}
+
+/* Vector butterflies over W = sizeof(V) / sizeof(fval_t) lanes. Only vector
+ * locals are used (no vector arguments or returns) so the ABI does not depend
+ * on the ISA the caller was compiled for */
+template <typename V>
+static inline __attribute__((always_inline))
+void _simd_stage_vec(size_t count, size_t half, fval_t *re, fval_t *im,
+                     const fval_t *tw_re, const fval_t *tw_im) {
+    constexpr size_t W = sizeof(V) / sizeof(fval_t);
+
+    for (size_t k = 0; k < count; k += half * 2) {
+        auto ar = re + k, ai = im + k;
+        auto br = ar + half, bi = ai + half;
+        for (size_t j = 0; j < half; j += W) {
+            V wr, wi, xr, xi, ur, ui;
+            std::memcpy(&wr, tw_re + j, sizeof(V));
+            std::memcpy(&wi, tw_im + j, sizeof(V));
+            std::memcpy(&xr, br + j, sizeof(V));
+            std::memcpy(&xi, bi + j, sizeof(V));
+            std::memcpy(&ur, ar + j, sizeof(V));
+            std::memcpy(&ui, ai + j, sizeof(V));
+
+            V tr = wr * xr - wi * xi;
+            V ti = wr * xi + wi * xr;
+
+            V sr = ur + tr, si = ui + ti;
+            V dr = ur - tr, di = ui - ti;
+            std::memcpy(ar + j, &sr, sizeof(V));
+            std::memcpy(ai + j, &si, sizeof(V));
+            std::memcpy(br + j, &dr, sizeof(V));
+            std::memcpy(bi + j, &di, sizeof(V));
+        }
+    }
+}
+
+template <typename V>
+static inline __attribute__((always_inline))
+void _simd_stages(const FFTPlan &plan, size_t count, fval_t *re, fval_t *im,
+                  const fval_t *tw_re, const fval_t *tw_im) {
+    constexpr size_t W = sizeof(V) / sizeof(fval_t);
+
+    for (size_t m = 2; m <= count; m <<= 1) {
+        auto half = m / 2;
+        auto off = half - 1;
+        if (half < W) {
+            _simd_stage_scalar(count, half, re, im, tw_re + off, tw_im + off);
+        } else {
+            _simd_stage_vec<V>(count, half, re, im, tw_re + off, tw_im + off);
+        }
+    }
+}
+
+typedef void (*simd_stages_fn)(const FFTPlan &, size_t, fval_t *, fval_t *, const fval_t *, const fval_t *);
+
+static void _simd_stages_scalar(const FFTPlan &plan, size_t count, fval_t *re, fval_t *im,
+                                const fval_t *tw_re, const fval_t *tw_im) {
+    for (size_t m = 2; m <= count; m <<= 1) {
+        auto off = m / 2 - 1;
+        _simd_stage_scalar(count, m / 2, re, im, tw_re + off, tw_im + off);
+    }
+}
+
+#if FFT_SIMD_X86
+__attribute__((target("sse2")))
+static void _simd_stages_sse(const FFTPlan &plan, size_t count, fval_t *re, fval_t *im,
+                             const fval_t *tw_re, const fval_t *tw_im) {
+    _simd_stages<v4sf_t>(plan, count, re, im, tw_re, tw_im);
+}
+
+__attribute__((target("avx2,fma")))
+static void _simd_stages_avx2(const FFTPlan &plan, size_t count, fval_t *re, fval_t *im,
+                              const fval_t *tw_re, const fval_t *tw_im) {
+    _simd_stages<v8sf_t>(plan, count, re, im, tw_re, tw_im);
+}
+
+__attribute__((target("avx512f")))
+static void _simd_stages_avx512(const FFTPlan &plan, size_t count, fval_t *re, fval_t *im,
+                                const fval_t *tw_re, const fval_t *tw_im) {
+    _simd_stages<v16sf_t>(plan, count, re, im, tw_re, tw_im);
+}
+#endif /* FFT_SIMD_X86 */
+
+static bool isa_supported(FFTSimdIsa isa) {
+    switch (isa) {
+    case FFTSimdIsa::Scalar:
+        return true;
+#if FFT_SIMD_X86
+    case FFTSimdIsa::SSE:
+        return __builtin_cpu_supports("sse2");
+    case FFTSimdIsa::AVX2:
+        return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+    case FFTSimdIsa::AVX512:
+        return __builtin_cpu_supports("avx512f");
+#endif
+    default:
+        return false;
+    }
+}
+
+FFTSimdIsa FFTCooleyTukeySIMDIterative::detect() {
+    for (auto isa : {FFTSimdIsa::AVX512, FFTSimdIsa::AVX2, FFTSimdIsa::SSE}) {
+        if (isa_supported(isa)) {
+            return isa;
+        }
+    }
+    return FFTSimdIsa::Scalar;
+}
+
+FFTCooleyTukeySIMDIterative::FFTCooleyTukeySIMDIterative(FFTSimdIsa isa) {
+    if ((isa == FFTSimdIsa::Auto) || !isa_supported(isa)) {
+        isa = detect();
+    }
+    this->isa = isa;
+}
+
+std::string FFTCooleyTukeySIMDIterative::ident() {
+    switch (this->isa) {
+    case FFTSimdIsa::SSE:
+        return "ct_simd_sse";
+    case FFTSimdIsa::AVX2:
+        return "ct_simd_avx2";
+    case FFTSimdIsa::AVX512:
+        return "ct_simd_avx512";
+    default:
+        return "ct_simd_scalar";
+    }
+}
+
+int FFTCooleyTukeySIMDIterative::fft(size_t count, cfval_t *input, cfval_t *output) {
+    auto &plan = this->plan_for(count);
+    if (!plan.supports(count)) {
+        return -1;
+    }
+
+    /* Split the plan's twiddles once per size */
+    if (this->tw_count != count) {
+        auto tw = plan.stage_twiddles(2);
+        this->tw_re.resize(count);
+        this->tw_im.resize(count);
+        for (size_t i = 0; i + 1 < count; i++) {
+            this->tw_re[i] = tw[i].real();
+            this->tw_im[i] = tw[i].imag();
+        }
+        this->re.resize(count);
+        this->im.resize(count);
+        this->tw_count = count;
+    }
+
+    auto re = this->re.data();
+    auto im = this->im.data();
+
+    /* Bit-reverse while de-interleaving into SoA form */
+    for (size_t i = 0; i < count; i++) {
+        auto r = plan.reverse(i, count);
+        re[r] = input[i].real();
+        im[r] = input[i].imag();
+    }
+
+    simd_stages_fn stages = _simd_stages_scalar;
+#if FFT_SIMD_X86
+    switch (this->isa) {
+    case FFTSimdIsa::SSE:
+        stages = _simd_stages_sse;
+        break;
+    case FFTSimdIsa::AVX2:
+        stages = _simd_stages_avx2;
+        break;
+    case FFTSimdIsa::AVX512:
+        stages = _simd_stages_avx512;
+        break;
+    default:
+        break;
+    }
+#endif
+    stages(plan, count, re, im, this->tw_re.data(), this->tw_im.data());
+
+    for (size_t i = 0; i < count; i++) {
+        output[i] = cfval_t(re[i], im[i]);
+    }
+
+    return 0;
+}
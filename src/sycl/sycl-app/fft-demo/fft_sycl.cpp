@@ -0,0 +1,353 @@
+#include "fft.hpp"
+
+#include <algorithm>
+#include <iostream>
+#include <string>
+#include <vector>
+
+/* std::complex arithmetic is not fully supported in SYCL device code on every
+ * target, so device kernels multiply through the real and imaginary parts */
+static inline cfval_t cmul(cfval_t a, cfval_t b) {
+    return cfval_t(a.real() * b.real() - a.imag() * b.imag(),
+                   a.real() * b.imag() + a.imag() * b.real());
+}
+
+static bool is_usm(const void *ptr, const sycl::queue &queue) {
+    return sycl::get_pointer_type(ptr, queue.get_context()) != sycl::usm::alloc::unknown;
+}
+
+/* Whether [a, a + n) and [b, b + n) share any element */
+static bool overlaps(const cfval_t *a, const cfval_t *b, size_t n) {
+    return (a < b + n) && (b < a + n);
+}
+
+
+/*
+ * Cooley-Tukey SYCL USM iterative
+ */
+FFTCooleyTukeySYCLUSMIterative::FFTCooleyTukeySYCLUSMIterative(sycl::queue &queue) :
+queue(queue.get_context(), queue.get_device(), sycl::property_list{sycl::property::queue::in_order()}) {
+}
+
+FFTCooleyTukeySYCLUSMIterative::~FFTCooleyTukeySYCLUSMIterative() {
+    this->release();
+}
+
+std::string FFTCooleyTukeySYCLUSMIterative::ident() {
+    return "ct_sycl_usm";
+}
+
+void FFTCooleyTukeySYCLUSMIterative::release() {
+    for (void *ptr : {(void *)this->dev_in, (void *)this->dev_out, (void *)this->dev_tw, (void *)this->dev_rev}) {
+        if (ptr) {
+            sycl::free(ptr, this->queue);
+        }
+    }
+    this->dev_in = nullptr;
+    this->dev_out = nullptr;
+    this->dev_tw = nullptr;
+    this->dev_rev = nullptr;
+    this->count = 0;
+    this->batch = 0;
+}
+
+int FFTCooleyTukeySYCLUSMIterative::prepare(size_t count, size_t batch) {
+    if ((this->count == count) && (this->batch >= batch)) {
+        return 0;
+    }
+
+    auto &plan = this->plan_for(count);
+    if (!plan.supports(count) || (count < 2)) {
+        return -1;
+    }
+
+    this->release();
+
+    try {
+        /* No staging buffers are needed when all data is already in USM */
+        if (batch) {
+            this->dev_in  = sycl::malloc_device<cfval_t>(count * batch, this->queue);
+            this->dev_out = sycl::malloc_device<cfval_t>(count * batch, this->queue);
+        }
+        this->dev_tw  = sycl::malloc_device<cfval_t>(count - 1, this->queue);
+        this->dev_rev = sycl::malloc_device<uint32_t>(count, this->queue);
+        if ((batch && (!this->dev_in || !this->dev_out)) || !this->dev_tw || !this->dev_rev) {
+            this->release();
+            return -1;
+        }
+
+        this->queue.memcpy(this->dev_tw, plan.stage_twiddles(2), (count - 1) * sizeof(cfval_t));
+        this->queue.memcpy(this->dev_rev, plan.bit_reverse_table(), count * sizeof(uint32_t));
+        this->queue.wait_and_throw();
+    } catch (const sycl::exception &e) {
+        std::cout << "Exception caught: " << e.what() << std::endl;
+        this->release();
+        return -1;
+    }
+
+    this->count = count;
+    this->batch = batch;
+
+    return 0;
+}
+
+int FFTCooleyTukeySYCLUSMIterative::fft(size_t count, cfval_t *input, cfval_t *output) {
+    if (this->prepare(count)) {
+        return -1;
+    }
+
+    auto in_usm = is_usm(input, this->queue);
+    auto out_usm = is_usm(output, this->queue);
+
+    /* The bit-reversal scatters, so in-place USM input is gathered into the
+     * staging buffer first like host input */
+    if (in_usm && out_usm && overlaps(input, output, count)) {
+        in_usm = false;
+    }
+
+    const cfval_t *src = in_usm ? input : this->dev_in;
+    cfval_t *dst = out_usm ? output : this->dev_out;
+    auto rev = this->dev_rev;
+    auto tw = this->dev_tw;
+
+    try {
+        /* The queue is in-order, so each kernel waits for the previous one
+         * without explicit dependencies */
+        if (!in_usm) {
+            this->queue.memcpy(this->dev_in, input, count * sizeof(cfval_t));
+        }
+
+        this->queue.parallel_for(sycl::range{count}, [=](sycl::id<1> idx) {
+            dst[rev[idx[0]]] = src[idx[0]];
+        });
+
+        for (auto i = 1; i <= __builtin_ctzl(count); i++) {
+            size_t half = 1 << (i - 1);
+            this->queue.parallel_for(sycl::range{count / 2}, [=](sycl::id<1> idx) {
+                size_t b = idx[0];
+                auto j = b & (half - 1);
+                auto k = (b - j) * 2;
+                auto t = cmul(tw[half - 1 + j], dst[k + j + half]);
+                auto u = dst[k + j];
+                dst[k + j] = u + t;
+                dst[k + j + half] = u - t;
+            });
+        }
+
+        if (!out_usm) {
+            this->queue.memcpy(output, this->dev_out, count * sizeof(cfval_t));
+        }
+
+        this->queue.wait_and_throw();
+    } catch (const sycl::exception &e) {
+        std::cout << "Exception caught: " << e.what() << std::endl;
+        return -1;
+    }
+
+    return 0;
+}
+
+BenchStats FFTCooleyTukeySYCLUSMIterative::measure_device(const BenchOptions &opts, size_t n_points) {
+    std::vector<cfval_t> xt_data(n_points);
+    gen_data(n_points, xt_data.data());
+
+    cfval_t *dev_xt = nullptr;
+    cfval_t *dev_xf = nullptr;
+    BenchStats stats;
+
+    try {
+        dev_xt = sycl::malloc_device<cfval_t>(n_points, this->queue);
+        dev_xf = sycl::malloc_device<cfval_t>(n_points, this->queue);
+        this->queue.memcpy(dev_xt, xt_data.data(), n_points * sizeof(cfval_t)).wait();
+
+        if (!this->fft(n_points, dev_xt, dev_xf)) {
+            stats = bench_measure_calls(opts, [&]() {
+                return this->fft(n_points, dev_xt, dev_xf);
+            });
+        }
+    } catch (const sycl::exception &e) {
+        std::cout << "Exception caught: " << e.what() << std::endl;
+    }
+
+    if (dev_xt) {
+        sycl::free(dev_xt, this->queue);
+    }
+    if (dev_xf) {
+        sycl::free(dev_xf, this->queue);
+    }
+
+    return stats;
+}
+
+
+/*
+ * Cooley-Tukey SYCL work-group iterative
+ */
+
+/* Largest block kept in local memory per work-group, and the largest
+ * work-group used */
+#define WG_LOCAL_MAX 4096
+#define WG_SIZE_MAX 256
+
+static size_t pow2_floor(size_t val) {
+    size_t res = 1;
+    while ((res << 1) <= val) {
+        res <<= 1;
+    }
+    return res;
+}
+
+FFTCooleyTukeySYCLLocalIterative::FFTCooleyTukeySYCLLocalIterative(sycl::queue &queue) :
+FFTCooleyTukeySYCLUSMIterative(queue) {
+    auto dev = this->queue.get_device();
+
+    /* Leave half of local memory free so more than one group fits per
+     * compute unit */
+    size_t local_mem = dev.get_info<sycl::info::device::local_mem_size>();
+    this->local_max = std::min<size_t>(WG_LOCAL_MAX, pow2_floor(std::max<size_t>(local_mem / 2 / sizeof(cfval_t), 2)));
+
+    size_t max_wg = dev.get_info<sycl::info::device::max_work_group_size>();
+    this->wg_size = std::min<size_t>(WG_SIZE_MAX, pow2_floor(max_wg));
+}
+
+std::string FFTCooleyTukeySYCLLocalIterative::ident() {
+    return "ct_sycl_wg";
+}
+
+void FFTCooleyTukeySYCLLocalIterative::enqueue(size_t count, size_t batch, const cfval_t *src, size_t src_stride, cfval_t *dst, size_t dst_stride) {
+    size_t log2_count = __builtin_ctzl(count);
+    auto block = std::min(count, this->local_max);
+    size_t log2_block = __builtin_ctzl(block);
+    auto wg = std::min(this->wg_size, block / 2);
+    auto blocks_per_fft = count / block;
+    auto rev = this->dev_rev;
+    auto tw = this->dev_tw;
+
+    /* A whole transform fits in one block, so the bit-reversal is folded into
+     * the load into local memory. Otherwise it is a separate pass and the
+     * blocks are contiguous runs of the reversed data */
+    auto fused_reverse = (blocks_per_fft == 1);
+
+    if (!fused_reverse) {
+        this->queue.parallel_for(sycl::range{batch * count}, [=](sycl::id<1> idx) {
+            auto t = idx[0] >> log2_count;
+            auto i = idx[0] & (count - 1);
+            dst[t * dst_stride + rev[i]] = src[t * src_stride + i];
+        });
+    }
+
+    this->queue.submit([&](sycl::handler &h) {
+        sycl::local_accessor<cfval_t, 1> local{sycl::range<1>(block), h};
+
+        h.parallel_for(sycl::nd_range<1>{sycl::range<1>(batch * blocks_per_fft * wg), sycl::range<1>(wg)},
+                       [=](sycl::nd_item<1> it) {
+            auto group = it.get_group(0);
+            auto lid = it.get_local_id(0);
+            auto t = group / blocks_per_fft;
+            auto out = dst + t * dst_stride + (group % blocks_per_fft) * block;
+
+            if (fused_reverse) {
+                auto in = src + t * src_stride;
+                for (auto i = lid; i < block; i += wg) {
+                    local[rev[i]] = in[i];
+                }
+            } else {
+                for (auto i = lid; i < block; i += wg) {
+                    local[i] = out[i];
+                }
+            }
+            sycl::group_barrier(it.get_group());
+
+            for (size_t s = 1; s <= log2_block; s++) {
+                size_t half = 1 << (s - 1);
+                for (auto b = lid; b < block / 2; b += wg) {
+                    auto j = b & (half - 1);
+                    auto k = (b - j) * 2;
+                    auto v = cmul(tw[half - 1 + j], local[k + j + half]);
+                    auto u = local[k + j];
+                    local[k + j] = u + v;
+                    local[k + j + half] = u - v;
+                }
+                sycl::group_barrier(it.get_group());
+            }
+
+            for (auto i = lid; i < block; i += wg) {
+                out[i] = local[i];
+            }
+        });
+    });
+
+    /* Stages longer than a block combine blocks through global memory */
+    for (auto s = log2_block + 1; s <= log2_count; s++) {
+        size_t half = 1 << (s - 1);
+        this->queue.parallel_for(sycl::range{batch * count / 2}, [=](sycl::id<1> idx) {
+            auto d = dst + (idx[0] >> (log2_count - 1)) * dst_stride;
+            auto b = idx[0] & (count / 2 - 1);
+            auto j = b & (half - 1);
+            auto k = (b - j) * 2;
+            auto v = cmul(tw[half - 1 + j], d[k + j + half]);
+            auto u = d[k + j];
+            d[k + j] = u + v;
+            d[k + j + half] = u - v;
+        });
+    }
+}
+
+int FFTCooleyTukeySYCLLocalIterative::fft(size_t count, cfval_t *input, cfval_t *output) {
+    return this->fft_batch(count, 1, count, input, output);
+}
+
+int FFTCooleyTukeySYCLLocalIterative::fft_batch(size_t count, size_t batch, size_t stride, cfval_t *input, cfval_t *output) {
+    if (batch == 0) {
+        return -1;
+    }
+
+    auto in_usm = is_usm(input, this->queue);
+    auto out_usm = is_usm(output, this->queue);
+
+    /* Past one block the bit-reversal is a separate scatter pass, so
+     * overlapping USM input is gathered into the staging buffer first like
+     * host input */
+    if (in_usm && out_usm && (count > this->local_max) &&
+        overlaps(input, output, (batch - 1) * stride + count)) {
+        in_usm = false;
+    }
+    if (this->prepare(count, (in_usm && out_usm) ? 0 : batch)) {
+        return -1;
+    }
+
+    try {
+        /* Host data is packed into the device buffers, USM data is used in
+         * place with the caller's stride */
+        if (!in_usm) {
+            if (stride == count) {
+                this->queue.memcpy(this->dev_in, input, batch * count * sizeof(cfval_t));
+            } else {
+                for (size_t b = 0; b < batch; b++) {
+                    this->queue.memcpy(this->dev_in + b * count, input + b * stride, count * sizeof(cfval_t));
+                }
+            }
+        }
+
+        this->enqueue(count, batch,
+                      in_usm ? input : this->dev_in, in_usm ? stride : count,
+                      out_usm ? output : this->dev_out, out_usm ? stride : count);
+
+        if (!out_usm) {
+            if (stride == count) {
+                this->queue.memcpy(output, this->dev_out, batch * count * sizeof(cfval_t));
+            } else {
+                for (size_t b = 0; b < batch; b++) {
+                    this->queue.memcpy(output + b * stride, this->dev_out + b * count, count * sizeof(cfval_t));
+                }
+            }
+        }
+
+        this->queue.wait_and_throw();
+    } catch (const sycl::exception &e) {
+        std::cout << "Exception caught: " << e.what() << std::endl;
+        return -1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,341 @@
+#include "fft_verify.hpp"
+#include "stft.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+/* Largest power of two checked against the direct DFT, larger ones use the
+ * double-precision FFT */
+#define VERIFY_DFT_MAX 4096
+
+/* Transforms per fft_batch() check */
+#define VERIFY_BATCH 3
+
+/* Samples through each FIR and STFT check, pushed in chunks cycling through
+ * VERIFY_CHUNKS so chunks end at every offset within blocks and frames */
+#define VERIFY_STREAM_SAMPLES 20000
+#define VERIFY_CHUNKS {1, 1000, 37, 4096, 513}
+
+bool FFTAccuracy::pass() const {
+    return !this->checked || (this->ok && (this->max_rel <= VERIFY_MAX_REL) && (this->rms_rel <= VERIFY_RMS_REL));
+}
+
+bool FFTVerifyResult::pass() const {
+    return this->fft.pass() && this->batch.pass() && this->real.pass() && this->inverse.pass() &&
+           this->real_inverse.pass();
+}
+
+static void reference_dft(size_t count, const std::complex<double> *input, std::complex<double> *output) {
+    /* Every product j * k reduces to one of `count` twiddles, each evaluated
+     * once in long double */
+    std::vector<std::complex<double>> tw(count);
+    for (size_t i = 0; i < count; i++) {
+        auto angle = -2.L * (long double)M_PI * (long double)i / (long double)count;
+        tw[i] = std::complex<double>((double)std::cos(angle), (double)std::sin(angle));
+    }
+
+    for (size_t k = 0; k < count; k++) {
+        std::complex<double> sum = 0;
+        size_t idx = 0;
+        for (size_t j = 0; j < count; j++) {
+            sum += input[j] * tw[idx];
+            idx += k;
+            if (idx >= count) {
+                idx -= count;
+            }
+        }
+        output[k] = sum;
+    }
+}
+
+void fft_reference(size_t count, const std::complex<double> *input, std::complex<double> *output) {
+    if ((count <= VERIFY_DFT_MAX) || (count & (count - 1))) {
+        reference_dft(count, input, output);
+        return;
+    }
+
+    FFTCooleyTukeyIterativeT<double> ref;
+    std::vector<std::complex<double>> ref_in(input, input + count);
+    ref.fft(count, ref_in.data(), output);
+}
+
+/* Seeded noise in [-0.5, 0.5), different for every `seed` */
+static void gen_noise(size_t count, uint32_t seed, std::vector<std::complex<double>> &data) {
+    data.resize(count);
+    for (size_t i = 0; i < count; i++) {
+        seed = seed * 1664525u + 1013904223u;
+        auto re = (double)(seed >> 8) / (double)(1 << 24) - 0.5;
+        seed = seed * 1664525u + 1013904223u;
+        auto im = (double)(seed >> 8) / (double)(1 << 24) - 0.5;
+        data[i] = std::complex<double>(re, im);
+    }
+}
+
+/* Sums for one accuracy figure, which may span several transforms */
+struct ErrorSums {
+    double err_max = 0;
+    double ref_max = 0;
+    double err_sq = 0;
+    double ref_sq = 0;
+
+    void add(size_t count, const cfval_t *result, const std::complex<double> *ref) {
+        for (size_t i = 0; i < count; i++) {
+            this->add_one(std::complex<double>(result[i].real(), result[i].imag()), ref[i]);
+        }
+    }
+
+    void add(size_t count, const fval_t *result, const double *ref) {
+        for (size_t i = 0; i < count; i++) {
+            this->add_one(result[i], ref[i]);
+        }
+    }
+
+    void add_one(std::complex<double> result, std::complex<double> ref) {
+        auto diff = result - ref;
+        this->err_max = std::max(this->err_max, std::abs(diff));
+        this->ref_max = std::max(this->ref_max, std::abs(ref));
+        this->err_sq += std::norm(diff);
+        this->ref_sq += std::norm(ref);
+    }
+
+    void store(FFTAccuracy &acc) const {
+        acc.ok = true;
+        acc.max_rel = this->ref_max ? this->err_max / this->ref_max : this->err_max;
+        acc.rms_rel = this->ref_sq ? std::sqrt(this->err_sq / this->ref_sq) : std::sqrt(this->err_sq);
+        /* NaN or infinite output never passes */
+        if (!std::isfinite(acc.max_rel) || !std::isfinite(acc.rms_rel)) {
+            acc.ok = false;
+        }
+    }
+};
+
+static void to_cfval(const std::vector<std::complex<double>> &input, cfval_t *output) {
+    for (size_t i = 0; i < input.size(); i++) {
+        output[i] = cfval_t((fval_t)input[i].real(), (fval_t)input[i].imag());
+    }
+}
+
+int fft_verify(FFTProvider &provider, size_t count, FFTVerifyResult &result) {
+    result = FFTVerifyResult();
+
+    std::vector<std::vector<std::complex<double>>> data(VERIFY_BATCH);
+    std::vector<std::vector<std::complex<double>>> ref(VERIFY_BATCH);
+    std::vector<cfval_t> xt_data(count * VERIFY_BATCH);
+    std::vector<cfval_t> xf_data(count * VERIFY_BATCH);
+
+    /* The reference works from the rounded single-precision input, so only
+     * the transform's own error is measured */
+    for (size_t b = 0; b < VERIFY_BATCH; b++) {
+        gen_noise(count, 12345 + (uint32_t)b, data[b]);
+        to_cfval(data[b], xt_data.data() + b * count);
+        for (size_t i = 0; i < count; i++) {
+            auto val = xt_data[b * count + i];
+            data[b][i] = std::complex<double>(val.real(), val.imag());
+        }
+        ref[b].resize(count);
+        fft_reference(count, data[b].data(), ref[b].data());
+    }
+
+    /* fft() */
+    result.fft.checked = true;
+    if (!provider.fft(count, xt_data.data(), xf_data.data())) {
+        ErrorSums sums;
+        sums.add(count, xf_data.data(), ref[0].data());
+        sums.store(result.fft);
+    }
+
+    /* fft_batch(), outputs cleared so a skipped transform shows */
+    result.batch.checked = true;
+    std::fill(xf_data.begin(), xf_data.end(), cfval_t(0, 0));
+    if (!provider.fft_batch(count, VERIFY_BATCH, count, xt_data.data(), xf_data.data())) {
+        ErrorSums sums;
+        for (size_t b = 0; b < VERIFY_BATCH; b++) {
+            sums.add(count, xf_data.data() + b * count, ref[b].data());
+        }
+        sums.store(result.batch);
+    }
+
+    /* ifft(fft(x)) == x */
+    result.inverse.checked = true;
+    std::vector<cfval_t> roundtrip(count);
+    if (!provider.fft(count, xt_data.data(), xf_data.data()) &&
+        !provider.ifft(count, xf_data.data(), roundtrip.data())) {
+        ErrorSums sums;
+        sums.add(count, roundtrip.data(), data[0].data());
+        sums.store(result.inverse);
+    }
+
+    /* rfft() of the real parts, power-of-two sizes only */
+    if ((count >= 4) && !(count & (count - 1))) {
+        result.real.checked = true;
+
+        std::vector<fval_t> xt_real(count);
+        std::vector<std::complex<double>> real_data(count);
+        std::vector<std::complex<double>> real_ref(count);
+        for (size_t i = 0; i < count; i++) {
+            xt_real[i] = xt_data[i].real();
+            real_data[i] = xt_real[i];
+        }
+        fft_reference(count, real_data.data(), real_ref.data());
+
+        std::vector<cfval_t> bins(count / 2 + 1);
+        if (!provider.rfft(count, xt_real.data(), bins.data())) {
+            ErrorSums sums;
+            sums.add(bins.size(), bins.data(), real_ref.data());
+            sums.store(result.real);
+        }
+
+        /* irfft(rfft(x)) == x */
+        result.real_inverse.checked = true;
+        std::vector<fval_t> real_roundtrip(count);
+        std::vector<double> real_in(xt_real.begin(), xt_real.end());
+        if (!provider.rfft(count, xt_real.data(), bins.data()) &&
+            !provider.irfft(count, bins.data(), real_roundtrip.data())) {
+            ErrorSums sums;
+            sums.add(count, real_roundtrip.data(), real_in.data());
+            sums.store(result.real_inverse);
+        }
+    }
+
+    return result.pass() ? 0 : -1;
+}
+
+int fft2d_verify(FFT2DProvider &provider, size_t rows, size_t cols, FFTAccuracy &result) {
+    result = FFTAccuracy();
+    result.checked = true;
+
+    auto points = rows * cols;
+    std::vector<std::complex<double>> data;
+    gen_noise(points, 54321, data);
+    std::vector<cfval_t> xt_data(points);
+    std::vector<cfval_t> xf_data(points);
+    to_cfval(data, xt_data.data());
+    for (size_t i = 0; i < points; i++) {
+        data[i] = std::complex<double>(xt_data[i].real(), xt_data[i].imag());
+    }
+
+    /* Every row, then every column of the result */
+    std::vector<std::complex<double>> ref(points);
+    for (size_t r = 0; r < rows; r++) {
+        fft_reference(cols, data.data() + r * cols, ref.data() + r * cols);
+    }
+    std::vector<std::complex<double>> column(rows);
+    std::vector<std::complex<double>> column_ref(rows);
+    for (size_t c = 0; c < cols; c++) {
+        for (size_t r = 0; r < rows; r++) {
+            column[r] = ref[r * cols + c];
+        }
+        fft_reference(rows, column.data(), column_ref.data());
+        for (size_t r = 0; r < rows; r++) {
+            ref[r * cols + c] = column_ref[r];
+        }
+    }
+
+    if (!provider.fft2d(rows, cols, xt_data.data(), xf_data.data())) {
+        ErrorSums sums;
+        sums.add(points, xf_data.data(), ref.data());
+        sums.store(result);
+    }
+
+    return result.pass() ? 0 : -1;
+}
+
+/* Real parts of seeded noise, rounded to fval_t */
+static std::vector<fval_t> gen_real_noise(size_t count, uint32_t seed) {
+    std::vector<std::complex<double>> data;
+    gen_noise(count, seed, data);
+    std::vector<fval_t> real(count);
+    for (size_t i = 0; i < count; i++) {
+        real[i] = (fval_t)data[i].real();
+    }
+    return real;
+}
+
+int fir_verify(FFTProvider &provider, ConvMethod method, size_t n_taps, FFTAccuracy &result) {
+    result = FFTAccuracy();
+    result.checked = true;
+
+    auto taps = gen_real_noise(n_taps, 777 + (uint32_t)n_taps);
+    auto input = gen_real_noise(VERIFY_STREAM_SAMPLES, 999);
+
+    std::vector<double> ref(input.size());
+    for (size_t n = 0; n < input.size(); n++) {
+        double sum = 0;
+        for (size_t k = 0; (k < n_taps) && (k <= n); k++) {
+            sum += (double)taps[k] * (double)input[n - k];
+        }
+        ref[n] = sum;
+    }
+
+    FIRFilter filter(provider, taps.data(), n_taps, method);
+    if (!filter.ok()) {
+        return -1;
+    }
+
+    std::vector<fval_t> output(input.size());
+    const size_t chunks[] = VERIFY_CHUNKS;
+    size_t done = 0;
+    for (size_t c = 0; done < input.size(); c++) {
+        auto n = std::min(chunks[c % (sizeof(chunks) / sizeof(chunks[0]))], input.size() - done);
+        if (filter.process(input.data() + done, n, output.data() + done)) {
+            return -1;
+        }
+        done += n;
+    }
+
+    ErrorSums sums;
+    sums.add(output.size(), output.data(), ref.data());
+    sums.store(result);
+
+    return result.pass() ? 0 : -1;
+}
+
+int stft_verify(FFTProvider &provider, size_t frame_size, size_t hop, FFTAccuracy &result) {
+    result = FFTAccuracy();
+    result.checked = true;
+
+    auto input = gen_real_noise(VERIFY_STREAM_SAMPLES, 4242);
+    std::vector<fval_t> window(frame_size);
+    STFTStream::make_window(STFTWindow::Hann, frame_size, window.data());
+
+    /* Only the output thread calls the sink, so the sums need no lock */
+    ErrorSums sums;
+    size_t expected = 0;
+    bool order_ok = true;
+    std::vector<std::complex<double>> frame(frame_size);
+    std::vector<std::complex<double>> ref(frame_size);
+    auto sink = [&](size_t index, const cfval_t *bins, size_t n_bins) {
+        if ((index != expected) || (n_bins != frame_size / 2 + 1)) {
+            order_ok = false;
+            return;
+        }
+        expected++;
+
+        /* The same single-precision products the stream windows with */
+        for (size_t i = 0; i < frame_size; i++) {
+            frame[i] = (double)(input[index * hop + i] * window[i]);
+        }
+        fft_reference(frame_size, frame.data(), ref.data());
+        sums.add(n_bins, bins, ref.data());
+    };
+
+    STFTStream stream(provider, frame_size, hop, STFTWindow::Hann, sink);
+    const size_t chunks[] = VERIFY_CHUNKS;
+    size_t done = 0;
+    for (size_t c = 0; done < input.size(); c++) {
+        auto n = std::min(chunks[c % (sizeof(chunks) / sizeof(chunks[0]))], input.size() - done);
+        if (stream.push(input.data() + done, n)) {
+            break;
+        }
+        done += n;
+    }
+
+    if (stream.finish() || !order_ok || (expected != (input.size() - frame_size) / hop + 1)) {
+        return -1;
+    }
+
+    sums.store(result);
+    return result.pass() ? 0 : -1;
+}
@@ -0,0 +1,76 @@
+#ifndef FFT_VERIFY_HPP
+#define FFT_VERIFY_HPP
+
+#include <complex>
+#include <cstddef>
+
+#include "conv.hpp"
+#include "fft.hpp"
+#include "fft2d.hpp"
+
+/*
+ * Correctness checks
+ *
+ * Providers are compared against a double-precision reference on seeded
+ * noise-like input. Errors are relative to the reference spectrum: max_rel is
+ * the largest per-bin error over the largest reference magnitude, rms_rel the
+ * RMS error over the RMS reference magnitude. Per-bin relative error is not
+ * used as it is meaningless for bins that are close to zero.
+ */
+
+/* Errors above these fail verification. Single-precision transforms of the
+ * sizes we run land around 1e-7 RMS, so these leave room for the longer
+ * accumulation chains of some algorithms but not for a wrong twiddle or a
+ * lost butterfly */
+#define VERIFY_MAX_REL 1e-4
+#define VERIFY_RMS_REL 1e-5
+
+struct FFTAccuracy {
+    /* False when the check does not apply, e.g. rfft of an odd size */
+    bool checked = false;
+    /* False when the provider returned an error */
+    bool ok = false;
+    double max_rel = 0;
+    double rms_rel = 0;
+
+    bool pass() const;
+};
+
+struct FFTVerifyResult {
+    /* fft() */
+    FFTAccuracy fft;
+    /* fft_batch() over several different inputs */
+    FFTAccuracy batch;
+    /* rfft() against the first count/2 + 1 reference bins */
+    FFTAccuracy real;
+    /* ifft(fft(x)) against x */
+    FFTAccuracy inverse;
+    /* irfft(rfft(x)) against the real x */
+    FFTAccuracy real_inverse;
+
+    bool pass() const;
+};
+
+/* Double-precision forward transform of any length. Powers of two above
+ * VERIFY_DFT_MAX use a radix-2 FFT with directly evaluated twiddles, all other
+ * sizes a direct DFT, so large odd sizes are slow */
+void fft_reference(size_t count, const std::complex<double> *input, std::complex<double> *output);
+
+/* Run every check for `count` point transforms on `provider`, 0 if all pass */
+int fft_verify(FFTProvider &provider, size_t count, FFTVerifyResult &result);
+
+/* `rows` x `cols` 2D transform against row and column reference transforms
+ * in double, 0 if it passes */
+int fft2d_verify(FFT2DProvider &provider, size_t rows, size_t cols, FFTAccuracy &result);
+
+/* An `n_taps` FIR filter with `method`, fed in uneven chunks so state carried
+ * between calls is exercised, against direct convolution in double. 0 if it
+ * passes */
+int fir_verify(FFTProvider &provider, ConvMethod method, size_t n_taps, FFTAccuracy &result);
+
+/* Every frame of a Hann-windowed STFT stream, fed in uneven chunks, against
+ * the reference transform of the same windowed samples. Missing, extra or
+ * out-of-order frames fail. 0 if it passes */
+int stft_verify(FFTProvider &provider, size_t frame_size, size_t hop, FFTAccuracy &result);
+
+#endif
@@ -1,14 +1,316 @@
+#include <algorithm>
+#include <chrono>
 #include <cmath>
+#include <string>
+#include <type_traits>
 
 #include <sycl/sycl.hpp>
 #include <vector>
 
+#include "conv.hpp"
 #include "fft.hpp"
+#include "fft2d.hpp"
+#include "fft_dispatch.hpp"
+#include "fft_planner.hpp"
+#include "fft_precision.hpp"
+#include "fft_verify.hpp"
+#include "stft.hpp"
 
 class scalar_add;
 
 static void display_devices();
 
+/* Benchmarked sizes are 2^FFT_POW_MIN to 2^FFT_POW_MAX points */
+#define FFT_POW_MIN 8
+#define FFT_POW_MAX 16
+
+/* Batched runs use up to FFT_BATCH_MAX transforms per call, capped to
+ * FFT_BATCH_POINTS points in total to bound memory use */
+#define FFT_BATCH_MAX 256
+#define FFT_BATCH_POINTS (1 << 22)
+
+/* Tuned provider choices are kept here between runs */
+#define FFT_WISDOM_FILE "fft-wisdom.txt"
+
+/* Large sizes 2^FFT_LARGE_POW_MIN to 2^FFT_LARGE_POW_MAX */
+#define FFT_LARGE_POW_MIN 18
+#define FFT_LARGE_POW_MAX 26
+
+/* Each streaming STFT sample pushes STFT_STREAM_SAMPLES samples in STFT_CHUNK
+ * sized pieces, with frames of 2^STFT_POW_MIN to 2^STFT_POW_MAX and a quarter
+ * frame hop */
+#define STFT_STREAM_SAMPLES (1 << 18)
+#define STFT_CHUNK 4096
+#define STFT_POW_MIN 8
+#define STFT_POW_MAX 12
+
+/* FIR filters of 2^CONV_POW_MIN to 2^CONV_POW_MAX taps, timed per
+ * CONV_CHUNK sized call */
+#define CONV_POW_MIN 4
+#define CONV_POW_MAX 14
+#define CONV_CHUNK 4096
+
+/* --verify also checks these sizes on the any-length providers */
+#define VERIFY_ODD_SIZES {12, 100, 1000, 1155, 4099}
+
+
+static void print_idents(std::vector<FFTProvider*> &fft_algos) {
+    for (auto i = 0; i < fft_algos.size(); i++) {
+        std::cout << fft_algos[i]->ident();
+        if (i != (fft_algos.size() - 1)) {
+            std::cout << ", ";
+        }
+    }
+    std::cout << std::endl;
+}
+
+static void print_row(size_t n_points, const std::vector<float> &values) {
+    std::cout << n_points << ", ";
+    for (auto i = 0; i < values.size(); i++) {
+        std::cout << values[i];
+        if (i != (values.size() - 1)) {
+            std::cout << ", ";
+        }
+    }
+    std::cout << std::endl;
+}
+
+/* Items per second at the median, 0 when the measurement failed */
+static float per_second(const BenchStats &stats, double items) {
+    return stats.ok ? (float)(items * 1e9 / stats.median) : 0;
+}
+
+/* Work of one `n_points` point complex transform, for the report */
+static double fft_flops(size_t n_points) {
+    return 5.0 * n_points * std::log2((double)n_points);
+}
+
+static double fft_bytes(size_t n_points) {
+    return 2.0 * n_points * sizeof(cfval_t);
+}
+
+/* Idents of the precision-generic transforms --algo selects */
+template <typename... P>
+static void precision_selected(const BenchOptions &opts, std::vector<std::string> &idents, P &... ffts) {
+    auto add = [&](auto &fft) {
+        if (bench_algo_selected(opts, fft.ident())) {
+            idents.push_back(fft.ident());
+        }
+    };
+    (add(ffts), ...);
+}
+
+/* Rate and relative error of each selected precision-generic transform,
+ * _Float16 is emulated on most hosts */
+template <typename... P>
+static void precision_row(const BenchOptions &opts, BenchReport &report, size_t n_points,
+                          std::vector<float> &rates, std::vector<float> &errors, P &... ffts) {
+    auto measure = [&](auto &fft) {
+        typedef typename std::decay<decltype(fft)>::type::sample_t S;
+        if (!bench_algo_selected(opts, fft.ident())) {
+            return;
+        }
+        auto stats = measure_precision(opts, fft, n_points);
+        report.add("type_" + fft.ident(), "host", n_points, stats,
+                   fft_flops(n_points), 2.0 * n_points * sizeof(S));
+        rates.push_back(per_second(stats, 1));
+        errors.push_back((float)error_precision(fft, n_points));
+    };
+    (measure(ffts), ...);
+}
+
+static void print_accuracy(const FFTAccuracy &acc, bool with_rms) {
+    if (!acc.checked) {
+        std::cout << (with_rms ? ", -, -" : ", -");
+    } else if (!acc.ok) {
+        std::cout << (with_rms ? ", error, error" : ", error");
+    } else {
+        std::cout << ", " << acc.max_rel;
+        if (with_rms) {
+            std::cout << ", " << acc.rms_rel;
+        }
+    }
+}
+
+/* Check every provider at every size, `any_len_algos` also at sizes that are
+ * not powers of two. Returns the number of failed checks */
+static int verify_providers(const std::vector<size_t> &sizes, const std::vector<FFTProvider*> &fft_algos,
+                            const std::vector<FFTProvider*> &any_len_algos) {
+    std::cout << "# errors against a double-precision reference, relative to the peak (max) and"
+              << " RMS (rms) reference magnitude" << std::endl;
+    std::cout << "FFT size, algo, fft max, fft rms, batch max, rfft max, ifft max, irfft max, result" << std::endl;
+
+    auto failures = 0;
+    for (auto n_points : sizes) {
+        std::vector<FFTProvider*> algos = any_len_algos;
+        if (!(n_points & (n_points - 1))) {
+            algos.insert(algos.begin(), fft_algos.begin(), fft_algos.end());
+        }
+
+        for (auto algo : algos) {
+            FFTVerifyResult result;
+            auto res = fft_verify(*algo, n_points, result);
+            std::cout << n_points << ", " << algo->ident();
+            print_accuracy(result.fft, true);
+            print_accuracy(result.batch, false);
+            print_accuracy(result.real, false);
+            print_accuracy(result.inverse, false);
+            print_accuracy(result.real_inverse, false);
+            std::cout << ", " << (res ? "FAIL" : "ok") << std::endl;
+            if (res) {
+                failures++;
+            }
+        }
+    }
+
+    return failures;
+}
+
+/* One row of the feature checks, returns 1 if it failed */
+static int verify_row(const std::string &size, const std::string &ident, const FFTAccuracy &acc, int res) {
+    std::cout << size << ", " << ident;
+    print_accuracy(acc, true);
+    std::cout << ", " << (res ? "FAIL" : "ok") << std::endl;
+    return res ? 1 : 0;
+}
+
+/* Check the 2D providers at non-square shapes, some narrower than a transpose
+ * tile. Returns the number of failed checks */
+static int verify_2d(const std::vector<FFT2DProvider*> &algos) {
+    std::cout << std::endl << "# 2D, errors against row and column reference transforms" << std::endl;
+    std::cout << "Shape, algo, max, rms, result" << std::endl;
+
+    auto failures = 0;
+    for (auto &shape : std::vector<std::pair<size_t, size_t>>{{8, 64}, {64, 32}, {32, 256}}) {
+        auto name = std::to_string(shape.first) + "x" + std::to_string(shape.second);
+        for (auto algo : algos) {
+            FFTAccuracy acc;
+            auto res = fft2d_verify(*algo, shape.first, shape.second, acc);
+            failures += verify_row(name, algo->ident(), acc, res);
+        }
+    }
+    return failures;
+}
+
+/* Check every FIR method on `provider` against direct convolution. Auto
+ * is one of the others once its crossover is measured, which would be timing,
+ * so it is not checked on its own. Returns the number of failed checks */
+static int verify_fir(FFTProvider &provider) {
+    std::cout << std::endl << "# FIR filtering, errors against direct convolution in double" << std::endl;
+    std::cout << "Taps, method, max, rms, result" << std::endl;
+
+    std::vector<std::pair<ConvMethod, std::string>> methods = {
+        {ConvMethod::Direct, "direct"},
+        {ConvMethod::OverlapAdd, "ola " + provider.ident()},
+        {ConvMethod::OverlapSave, "ols " + provider.ident()},
+    };
+
+    auto failures = 0;
+    for (size_t n_taps : {1, 5, 64, 300, 1500}) {
+        for (auto &method : methods) {
+            FFTAccuracy acc;
+            auto res = fir_verify(provider, method.first, n_taps, acc);
+            failures += verify_row(std::to_string(n_taps), method.second, acc, res);
+        }
+    }
+    return failures;
+}
+
+/* Check STFT frames on every provider at a few frame and hop sizes. Returns
+ * the number of failed checks */
+static int verify_stft(const std::vector<FFTProvider*> &algos) {
+    std::cout << std::endl << "# streaming STFT, errors of every frame against the reference transform" << std::endl;
+    std::cout << "Frame/hop, algo, max, rms, result" << std::endl;
+
+    auto failures = 0;
+    for (auto &sizes : std::vector<std::pair<size_t, size_t>>{{64, 16}, {256, 256}, {1024, 300}}) {
+        auto name = std::to_string(sizes.first) + "/" + std::to_string(sizes.second);
+        for (auto algo : algos) {
+            FFTAccuracy acc;
+            auto res = stft_verify(*algo, sizes.first, sizes.second, acc);
+            failures += verify_row(name, algo->ident(), acc, res);
+        }
+    }
+    return failures;
+}
+
+/* Check every selected sample type against the long double reference with
+ * its own bound. Returns the number of failed checks */
+template <typename... P>
+static int verify_precision(const BenchOptions &opts, const std::vector<size_t> &sizes, P &... ffts) {
+    std::vector<std::string> idents;
+    precision_selected(opts, idents, ffts...);
+    if (idents.empty()) {
+        return 0;
+    }
+
+    std::cout << std::endl << "# sample types, relative RMS error against long double" << std::endl;
+    std::cout << "FFT size, algo, rms, bound, result" << std::endl;
+
+    auto failures = 0;
+    auto check = [&](auto &fft, size_t n_points) {
+        typedef typename std::decay<decltype(fft)>::type::sample_t S;
+        if (!bench_algo_selected(opts, fft.ident())) {
+            return;
+        }
+        auto bound = precision_bound<S>::rms;
+        auto err = error_precision(fft, n_points);
+        auto ok = (err >= 0) && (err <= bound);
+        std::cout << n_points << ", " << fft.ident() << ", " << err << ", " << bound << ", "
+                  << (ok ? "ok" : "FAIL") << std::endl;
+        failures += ok ? 0 : 1;
+    };
+    for (auto n_points : sizes) {
+        if (!(n_points & (n_points - 1))) {
+            (check(ffts, n_points), ...);
+        }
+    }
+    return failures;
+}
+
+/* Per-frame time distribution through a Hann-windowed STFT stream, one
+ * stream per sample. The maximum frame latency over all samples in
+ * microseconds is stored to `latency_us` */
+static BenchStats measure_stft(const BenchOptions &opts, FFTProvider *provider, size_t frame_size, float &latency_us) {
+    std::vector<fval_t> chunk(STFT_CHUNK);
+    for (size_t i = 0; i < chunk.size(); i++) {
+        chunk[i] = std::sin(0.05f * (float)i) + 0.25f * std::sin(0.7f * (float)i);
+    }
+
+    fval_t peak = 0;
+    auto sink = [&](size_t frame, const cfval_t *bins, size_t n_bins) {
+        peak = std::max(peak, std::abs(bins[n_bins / 8]));
+    };
+
+    latency_us = 0;
+    auto stats = bench_measure(opts, [&]() -> double {
+        STFTStream stream(*provider, frame_size, frame_size / 4, STFTWindow::Hann, sink);
+
+        auto start = std::chrono::high_resolution_clock::now();
+        for (size_t pushed = 0; pushed < STFT_STREAM_SAMPLES; pushed += chunk.size()) {
+            if (stream.push(chunk.data(), chunk.size())) {
+                stream.finish();
+                return -1;
+            }
+        }
+        auto res = stream.finish();
+        auto end = std::chrono::high_resolution_clock::now();
+
+        if (res || !stream.frames()) {
+            return -1;
+        }
+
+        latency_us = std::max(latency_us, stream.latency_max_us());
+        auto runtime = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+        return (double)runtime / (double)stream.frames();
+    });
+
+    if (!stats.ok) {
+        latency_us = 0;
+    }
+    return stats;
+}
+
 int cust_device_selector(const sycl::device &dev) {
     if (dev.has(sycl::aspect::cpu)) {
         auto vendorName = dev.get_info<sycl::info::device::vendor>();
@@ -20,15 +322,29 @@ int cust_device_selector(const sycl::device &dev) {
     return -1;
 }
 
-int main() {
-    auto sycl_queue = sycl::queue{sycl::default_selector_v};
-    //auto sycl_queue = sycl::queue{sycl::cpu_selector_v};
-    //auto sycl_queue = sycl::queue{sycl::gpu_selector_v};
+int main(int argc, char **argv) {
+    BenchOptions opts;
+    auto args = bench_parse_args(argc, argv, opts);
+    if (args) {
+        return (args < 0) ? 1 : 0;
+    }
+
+    /* --device picks the SYCL device, the default selector otherwise */
+    std::string device_sel = opts.devices.empty() ? "default" : opts.devices.front();
+    sycl::queue sycl_queue;
+    if (device_sel == "gpu") {
+        sycl_queue = sycl::queue{sycl::gpu_selector_v};
+    } else if (device_sel == "cpu") {
+        sycl_queue = sycl::queue{sycl::cpu_selector_v};
+    } else {
+        sycl_queue = sycl::queue{sycl::default_selector_v};
+    }
     //auto sycl_queue = sycl::queue{cust_device_selector};
 
-    std::cout << "Chosen SYCL device: "
-              << sycl_queue.get_device().get_info<sycl::info::device::name>()
-              << std::endl;
+    auto device_name = sycl_queue.get_device().get_info<sycl::info::device::name>();
+    std::cout << "Chosen SYCL device: " << device_name << std::endl;
+
+    BenchReport report("fft-demo", opts);
 
 #if 0
     auto fft = new FFTCooleyTukeyStackIterative();
@@ -57,36 +373,491 @@ int main() {
         std::cout << std::abs(freq_domain[i]) << std::endl;
     }
 #else
+    /* The one pool behind every multithreaded provider */
+    ThreadPool pool(-1);
+
+    auto ct_iter = new FFTCooleyTukeyIterative();
+    auto ct_simd = new FFTCooleyTukeySIMDIterative();
+    auto sr_recur = new FFTSplitRadixRecursive();
+    auto sycl_usm = new FFTCooleyTukeySYCLUSMIterative(sycl_queue);
+    auto sycl_wg = new FFTCooleyTukeySYCLLocalIterative(sycl_queue);
+    /* --verify checks the planner's candidates directly, so it neither tunes
+     * nor touches the wisdom file there */
+    auto planner = new FFTPlanner(opts.verify ? "" : FFT_WISDOM_FILE, pool, &sycl_queue);
+
+    std::vector<FFTProvider*> all_algos;
+    //all_algos.push_back(new FFTCooleyTukeyRecursive());
+    all_algos.push_back(ct_iter);
+    all_algos.push_back(ct_simd);
+    all_algos.push_back(new FFTCooleyTukeyRadix4Iterative());
+    all_algos.push_back(sr_recur);
+    //all_algos.push_back(new FFTCooleyTukeySplitRecursive());
+    //all_algos.push_back(new FFTCooleyTukeySplitIterative());
+    all_algos.push_back(new FFTCooleyTukeyMultithreadedIterative(pool, 3));
+    all_algos.push_back(new FFTCooleyTukeyMultithreadedIterative(pool, 4));
+    all_algos.push_back(new FFTCooleyTukeySYCLIterative(sycl_queue, 3));
+    all_algos.push_back(new FFTCooleyTukeySYCLIterative(sycl_queue, 4));
+    all_algos.push_back(sycl_usm);
+    all_algos.push_back(sycl_wg);
+    if (!opts.verify) {
+        all_algos.push_back(planner);
+    }
+
+    /* --algo narrows the provider tables, and the feature tables further down
+     * to the providers of theirs it names */
     std::vector<FFTProvider*> fft_algos;
-    //fft_algos.push_back(new FFTCooleyTukeyRecursive());
-    fft_algos.push_back(new FFTCooleyTukeyIterative());
-    //fft_algos.push_back(new FFTCooleyTukeySplitRecursive());
-    //fft_algos.push_back(new FFTCooleyTukeySplitIterative());
-    fft_algos.push_back(new FFTCooleyTukeyMultithreadedIterative(3));
-    fft_algos.push_back(new FFTCooleyTukeyMultithreadedIterative(4));
-    fft_algos.push_back(new FFTCooleyTukeySYCLIterative(sycl_queue, 3));
-    fft_algos.push_back(new FFTCooleyTukeySYCLIterative(sycl_queue, 4));
+    for (auto algo : all_algos) {
+        if (bench_algo_selected(opts, algo->ident())) {
+            fft_algos.push_back(algo);
+        }
+    }
+
+    std::vector<size_t> default_sizes;
+    for (auto i = FFT_POW_MIN; i <= FFT_POW_MAX; i++) {
+        default_sizes.push_back(1 << i);
+    }
+
+    /* Transforms below the calibrated crossover run on the host, larger ones
+     * and batches in one launch on the device */
+    SyclDispatch dispatch;
+    auto dispatch_dev = dispatch.add_device(sycl_queue, device_sel);
+    report.add("launch", device_name, 0, dispatch.launch_overhead(dispatch_dev), 0, 0);
+    auto dispatched = new FFTDispatch(ct_simd, sycl_wg, dispatch, dispatch_dev);
+    if (!opts.verify && bench_algo_selected(opts, dispatched->ident())) {
+        dispatched->calibrate(default_sizes, FFT_BATCH_MAX, FFT_BATCH_POINTS);
+        fft_algos.push_back(dispatched);
+    }
+
+    /* --verify checks results instead of timing, and includes the providers
+     * that are too slow to benchmark along with both join variants */
+    if (opts.verify) {
+        std::vector<FFTProvider*> verify_algos;
+        verify_algos.push_back(new FFTCooleyTukeyRecursive());
+        verify_algos.push_back(new FFTCooleyTukeySplitRecursive());
+        verify_algos.push_back(new FFTCooleyTukeySplitRecursive(true));
+        verify_algos.push_back(new FFTCooleyTukeySplitIterative());
+        verify_algos.push_back(new FFTFourStep(pool));
+        verify_algos.insert(verify_algos.end(), all_algos.begin(), all_algos.end());
+
+        std::vector<FFTProvider*> any_len_algos;
+        any_len_algos.push_back(new FFTMixedRadix());
+        any_len_algos.push_back(new FFTBluestein());
+
+        auto selected = [&](std::vector<FFTProvider*> &algos) {
+            algos.erase(std::remove_if(algos.begin(), algos.end(), [&](FFTProvider *algo) {
+                return !bench_algo_selected(opts, algo->ident());
+            }), algos.end());
+        };
+        selected(verify_algos);
+        selected(any_len_algos);
+
+        /* The dispatcher is not calibrated here, timing has nothing to do with
+         * correctness. Both of its sides are checked at forced crossovers */
+        if (bench_algo_selected(opts, dispatched->ident())) {
+            auto dispatch_host = new FFTDispatch(ct_simd, sycl_wg, dispatch, dispatch_dev);
+            dispatch_host->force(SyclDispatch::NEVER);
+            verify_algos.push_back(dispatch_host);
+
+            auto dispatch_device = new FFTDispatch(ct_simd, sycl_wg, dispatch, dispatch_dev);
+            dispatch_device->force(0);
+            verify_algos.push_back(dispatch_device);
+        }
+
+        std::vector<size_t> verify_sizes = default_sizes;
+        for (auto n_points : VERIFY_ODD_SIZES) {
+            verify_sizes.push_back(n_points);
+        }
+
+        verify_sizes = bench_sizes(opts, verify_sizes);
+        auto failures = verify_providers(verify_sizes, verify_algos, any_len_algos);
+
+        std::vector<FFT2DProvider*> fft2d_algos;
+        for (FFT2DProvider *algo : std::vector<FFT2DProvider*>{
+                 new FFT2DRowColumn(*ct_iter), new FFT2DRowColumn(*ct_simd), new FFT2DParallel(pool), new FFT2DSYCL(sycl_queue),
+             }) {
+            if (bench_algo_selected(opts, algo->ident())) {
+                fft2d_algos.push_back(algo);
+            } else {
+                delete algo;
+            }
+        }
+        if (!fft2d_algos.empty()) {
+            failures += verify_2d(fft2d_algos);
+        }
+
+        if (bench_algo_selected(opts, ct_simd->ident())) {
+            failures += verify_fir(*ct_simd);
+        }
+
+        std::vector<FFTProvider*> stft_algos = {ct_iter, ct_simd, sr_recur};
+        selected(stft_algos);
+        if (!stft_algos.empty()) {
+            failures += verify_stft(stft_algos);
+        }
 
+        FFTCooleyTukeyIterativeT<float> fft_f32;
+        FFTCooleyTukeyIterativeT<double> fft_f64;
+#if FFT_HAVE_FLOAT16
+        FFTCooleyTukeyIterativeT<_Float16> fft_f16;
+#endif
+        FFTFixedIterative<int16_t> fft_q15;
+        FFTFixedIterative<int32_t> fft_q31;
+        failures += verify_precision(opts, verify_sizes, fft_f32, fft_f64,
+#if FFT_HAVE_FLOAT16
+                                     fft_f16,
+#endif
+                                     fft_q15, fft_q31);
+
+        std::cout << std::endl << "# " << failures << " failed" << std::endl;
+        return failures ? 1 : 0;
+    }
+    auto sizes = bench_sizes(opts, default_sizes);
+
+    std::cout << "# FFTs per second at the median of " << opts.repeat << " samples"
+              << (opts.cold ? ", cold cache" : "") << std::endl;
     std::cout << "FFT size, ";
-    for (auto i = 0; i < fft_algos.size(); i++) {
-        std::cout << fft_algos[i]->ident();
-        if (i != (fft_algos.size() - 1)) {
-            std::cout << ", ";
+    print_idents(fft_algos);
+
+    /* Heap allocations per FFT, printed as a second table after the rates */
+    std::vector<std::vector<float>> fft_allocs;
+
+    for (auto n_points : sizes) {
+        std::vector<float> rates;
+        fft_allocs.emplace_back(fft_algos.size());
+        for (auto i = 0; i < fft_algos.size(); i++) {
+            auto stats = fft_algos[i]->measure(opts, n_points, &fft_allocs.back()[i]);
+            rates.push_back(per_second(stats, 1));
+            report.add(fft_algos[i]->ident(), device_name, n_points, stats, fft_flops(n_points), fft_bytes(n_points));
         }
+        print_row(n_points, rates);
+    }
+
+    if (bench_algo_selected(opts, planner->ident())) {
+        std::cout << std::endl << "# " << planner->ident() << " choice per size, wisdom in " << FFT_WISDOM_FILE << std::endl;
+        for (auto n_points : sizes) {
+            std::cout << n_points << ", " << planner->choice(n_points) << std::endl;
+        }
+    }
+
+    std::cout << std::endl << "# heap allocations per FFT" << std::endl;
+    for (auto i = 0; i < sizes.size(); i++) {
+        print_row(sizes[i], fft_allocs[i]);
     }
-    std::cout << std::endl;
 
-    for (auto i = 8; i <= 16; i++) {
-        auto n_points = 1 << i;
+    /* The tables below are rates at the median of the same samples */
+    std::cout << std::endl << "# batched, FFTs per second with up to "
+              << FFT_BATCH_MAX << " transforms per call" << std::endl;
+    std::cout << "FFT size, batch, ";
+    print_idents(fft_algos);
+
+    for (auto n_points : sizes) {
+        auto batch = std::max<size_t>(1, std::min<size_t>(FFT_BATCH_MAX, FFT_BATCH_POINTS / n_points));
+        std::vector<float> rates;
+        for (auto i = 0; i < fft_algos.size(); i++) {
+            auto stats = fft_algos[i]->measure_batch(opts, n_points, batch);
+            rates.push_back(per_second(stats, batch));
+            report.add("batch_" + fft_algos[i]->ident(), device_name, n_points, stats,
+                       fft_flops(n_points) * batch, fft_bytes(n_points) * batch);
+        }
         std::cout << n_points << ", ";
+        print_row(batch, rates);
+    }
+
+    /* The feature tables below each keep the providers --algo names and the
+     * sizes of their own range that --size names, and are left out when
+     * nothing of them is left */
+    auto selected_of = [&](const std::vector<FFTProvider*> &algos) {
+        std::vector<FFTProvider*> kept;
+        for (auto algo : algos) {
+            if (bench_algo_selected(opts, algo->ident())) {
+                kept.push_back(algo);
+            }
+        }
+        return kept;
+    };
+
+    std::vector<FFTCooleyTukeySYCLUSMIterative*> resident_all = {sycl_usm, sycl_wg};
+    std::vector<FFTCooleyTukeySYCLUSMIterative*> resident_algos;
+    for (auto algo : resident_all) {
+        if (bench_algo_selected(opts, algo->ident())) {
+            resident_algos.push_back(algo);
+        }
+    }
+    auto resident_sizes = bench_sizes_in(opts, default_sizes);
+    if (!resident_algos.empty() && !resident_sizes.empty()) {
+        std::cout << std::endl << "# data resident in USM device memory, FFTs per second" << std::endl;
+        std::cout << "FFT size";
+        for (auto algo : resident_algos) {
+            std::cout << ", " << algo->ident();
+        }
+        std::cout << std::endl;
+        for (auto n_points : resident_sizes) {
+            std::vector<float> rates;
+            for (auto algo : resident_algos) {
+                auto stats = algo->measure_device(opts, n_points);
+                rates.push_back(per_second(stats, 1));
+                report.add("resident_" + algo->ident(), device_name, n_points, stats, fft_flops(n_points), fft_bytes(n_points));
+            }
+            print_row(n_points, rates);
+        }
+    }
+
+    /* Beyond cache. Providers run one at a time and are freed afterwards, at
+     * 2^26 points each one's tables are over a gigabyte */
+    std::vector<size_t> large_range;
+    for (auto i = FFT_LARGE_POW_MIN; i <= FFT_LARGE_POW_MAX; i++) {
+        large_range.push_back((size_t)1 << i);
+    }
+    auto large_sizes = bench_sizes_in(opts, large_range);
+    std::vector<std::string> large_idents;
+    std::vector<std::vector<float>> large_rates(large_sizes.size());
+    for (auto p = 0; !large_sizes.empty() && (p < 4); p++) {
+        FFTProvider *algo;
+        switch (p) {
+        case 0:
+            algo = new FFTCooleyTukeyIterative();
+            break;
+        case 1:
+            algo = new FFTCooleyTukeySIMDIterative();
+            break;
+        case 2:
+            algo = new FFTCooleyTukeyMultithreadedIterative(pool, 4);
+            break;
+        default:
+            algo = new FFTFourStep(pool);
+            break;
+        }
+        if (bench_algo_selected(opts, algo->ident())) {
+            large_idents.push_back(algo->ident());
+            for (size_t i = 0; i < large_sizes.size(); i++) {
+                auto n_points = large_sizes[i];
+                auto stats = algo->measure(opts, n_points);
+                large_rates[i].push_back(per_second(stats, 1));
+                report.add("large_" + algo->ident(), "host", n_points, stats, fft_flops(n_points), fft_bytes(n_points));
+            }
+        }
+        delete algo;
+    }
+
+    if (!large_idents.empty()) {
+        std::cout << std::endl << "# large sizes, FFTs per second" << std::endl;
+        std::cout << "FFT size, ";
+        for (auto i = 0; i < large_idents.size(); i++) {
+            std::cout << large_idents[i];
+            if (i != (large_idents.size() - 1)) {
+                std::cout << ", ";
+            }
+        }
+        std::cout << std::endl;
+        for (size_t i = 0; i < large_sizes.size(); i++) {
+            print_row(large_sizes[i], large_rates[i]);
+        }
+    }
+
+    /* Sizes that are not a power of two, against zero-padding to the next
+     * power of two with the plain iterative transform */
+    auto any_len_algos = selected_of({new FFTMixedRadix(), new FFTBluestein()});
+    auto padded = new FFTCooleyTukeyIterative();
+    auto with_padded = bench_algo_selected(opts, padded->ident());
+    auto any_len_sizes = bench_sizes_in(opts, {1000, 1009, 1536, 3000, 4096, 10000});
+
+    if ((!any_len_algos.empty() || with_padded) && !any_len_sizes.empty()) {
+        std::cout << std::endl << "# arbitrary sizes, FFTs per second" << std::endl;
+        std::cout << "FFT size";
+        for (auto algo : any_len_algos) {
+            std::cout << ", " << algo->ident();
+        }
+        if (with_padded) {
+            std::cout << ", " << padded->ident() << " zero-padded";
+        }
+        std::cout << std::endl;
+
+        for (auto n_points : any_len_sizes) {
+            std::vector<float> rates;
+            for (auto algo : any_len_algos) {
+                auto stats = algo->measure(opts, n_points);
+                rates.push_back(per_second(stats, 1));
+                report.add("any_" + algo->ident(), "host", n_points, stats, fft_flops(n_points), fft_bytes(n_points));
+            }
+            if (with_padded) {
+                size_t pow2 = 1;
+                while (pow2 < n_points) {
+                    pow2 <<= 1;
+                }
+                auto stats = padded->measure(opts, pow2);
+                rates.push_back(per_second(stats, 1));
+                report.add("any_padded_" + padded->ident(), "host", n_points, stats, fft_flops(pow2), fft_bytes(pow2));
+            }
+            print_row(n_points, rates);
+        }
+    }
+
+    std::cout << std::endl << "# real input (rfft), FFTs per second" << std::endl;
+    std::cout << "FFT size, ";
+    print_idents(fft_algos);
+
+    for (auto n_points : sizes) {
+        std::vector<float> rates;
         for (auto i = 0; i < fft_algos.size(); i++) {
-            auto fft_rate = fft_algos[i]->benchmark(256, n_points);
-            std::cout << fft_rate;
-            if (i != (fft_algos.size() - 1)) {
+            auto stats = fft_algos[i]->measure_real(opts, n_points);
+            rates.push_back(per_second(stats, 1));
+            report.add("rfft_" + fft_algos[i]->ident(), device_name, n_points, stats, fft_flops(n_points / 2),
+                       n_points * sizeof(fval_t) + (n_points / 2 + 1) * sizeof(cfval_t));
+        }
+        print_row(n_points, rates);
+    }
+
+    auto stft_algos = selected_of({ct_iter, ct_simd, sr_recur});
+    std::vector<size_t> stft_range;
+    for (auto i = STFT_POW_MIN; i <= STFT_POW_MAX; i++) {
+        stft_range.push_back((size_t)1 << i);
+    }
+    auto stft_sizes = bench_sizes_in(opts, stft_range);
+
+    if (!stft_algos.empty() && !stft_sizes.empty()) {
+        std::cout << std::endl << "# streaming STFT, Hann window, hop = frame / 4, frames per second" << std::endl;
+        std::cout << "Frame size, ";
+        print_idents(stft_algos);
+
+        std::vector<std::vector<float>> stft_latency;
+        for (auto frame_size : stft_sizes) {
+            std::vector<float> rates;
+            stft_latency.emplace_back(stft_algos.size());
+            for (auto i = 0; i < stft_algos.size(); i++) {
+                auto stats = measure_stft(opts, stft_algos[i], frame_size, stft_latency.back()[i]);
+                rates.push_back(per_second(stats, 1));
+                report.add("stft_" + stft_algos[i]->ident(), "host", frame_size, stats, fft_flops(frame_size / 2),
+                           frame_size * sizeof(fval_t) + (frame_size / 2 + 1) * sizeof(cfval_t));
+            }
+            print_row(frame_size, rates);
+        }
+
+        std::cout << std::endl << "# streaming STFT, maximum frame latency (us)" << std::endl;
+        for (size_t i = 0; i < stft_sizes.size(); i++) {
+            print_row(stft_sizes[i], stft_latency[i]);
+        }
+    }
+
+    /* Every FIR method runs on ct_simd, the table follows its selection */
+    std::vector<size_t> conv_range;
+    for (auto i = CONV_POW_MIN; i <= CONV_POW_MAX; i += 2) {
+        conv_range.push_back((size_t)1 << i);
+    }
+    auto conv_sizes = bench_sizes_in(opts, conv_range);
+
+    if (bench_algo_selected(opts, ct_simd->ident()) && !conv_sizes.empty()) {
+        std::cout << std::endl << "# FIR filtering, Msamples per second, auto runs direct form up to "
+                  << FIRFilter::direct_max_taps(*ct_simd) << " taps" << std::endl;
+        std::cout << "Taps, direct, ola, ols, auto" << std::endl;
+
+        for (auto n_taps : conv_sizes) {
+            std::vector<fval_t> taps(n_taps);
+            for (size_t k = 0; k < n_taps; k++) {
+                taps[k] = std::exp(-4.0f * (float)k / (float)n_taps) / (float)n_taps;
+            }
+
+            /* Work is reported as the direct form's multiply-adds for every method */
+            std::vector<float> rates;
+            for (auto method : {ConvMethod::Direct, ConvMethod::OverlapAdd, ConvMethod::OverlapSave, ConvMethod::Auto}) {
+                FIRFilter filter(*ct_simd, taps.data(), n_taps, method);
+                auto stats = filter.measure(opts, CONV_CHUNK);
+                rates.push_back(per_second(stats, CONV_CHUNK) / 1e6f);
+                std::string algo = (method == ConvMethod::Auto) ? "auto" : filter.ident();
+                report.add("fir_" + algo, "host", n_taps, stats,
+                           2.0 * n_taps * CONV_CHUNK, 2.0 * CONV_CHUNK * sizeof(fval_t));
+            }
+            print_row(n_taps, rates);
+        }
+    }
+
+    std::vector<FFT2DProvider*> fft2d_all = {
+        new FFT2DRowColumn(*ct_iter), new FFT2DRowColumn(*ct_simd), new FFT2DParallel(pool), new FFT2DSYCL(sycl_queue),
+    };
+    std::vector<FFT2DProvider*> fft2d_algos;
+    for (auto algo : fft2d_all) {
+        if (bench_algo_selected(opts, algo->ident())) {
+            fft2d_algos.push_back(algo);
+        } else {
+            delete algo;
+        }
+    }
+
+    /* --size picks 2D shapes by their number of points */
+    std::vector<std::pair<size_t, size_t>> fft2d_sizes;
+    for (auto &size : std::vector<std::pair<size_t, size_t>>{
+             {64, 64}, {256, 256}, {1024, 1024}, {2048, 2048},
+             {64, 4096}, {4096, 64}, {256, 1024}, {1024, 256},
+         }) {
+        if (!bench_sizes_in(opts, {size.first * size.second}).empty()) {
+            fft2d_sizes.push_back(size);
+        }
+    }
+
+    if (!fft2d_algos.empty() && !fft2d_sizes.empty()) {
+        std::cout << std::endl << "# 2D, FFTs per second" << std::endl;
+        std::cout << "Rows, cols, ";
+        for (auto i = 0; i < fft2d_algos.size(); i++) {
+            std::cout << fft2d_algos[i]->ident();
+            if (i != (fft2d_algos.size() - 1)) {
                 std::cout << ", ";
             }
         }
         std::cout << std::endl;
+
+        for (auto &size : fft2d_sizes) {
+            auto n_points = size.first * size.second;
+            std::vector<float> rates;
+            for (auto algo : fft2d_algos) {
+                auto stats = algo->measure(opts, size.first, size.second);
+                rates.push_back(per_second(stats, 1));
+                report.add("2d_" + algo->ident() + "_" + std::to_string(size.first) + "x" + std::to_string(size.second),
+                           device_name, n_points, stats, fft_flops(n_points), fft_bytes(n_points));
+            }
+            std::cout << size.first << ", ";
+            print_row(size.second, rates);
+        }
+    }
+
+    FFTCooleyTukeyIterativeT<float> fft_f32;
+    FFTCooleyTukeyIterativeT<double> fft_f64;
+#if FFT_HAVE_FLOAT16
+    FFTCooleyTukeyIterativeT<_Float16> fft_f16;
+#endif
+    FFTFixedIterative<int16_t> fft_q15;
+    FFTFixedIterative<int32_t> fft_q31;
+
+    std::vector<std::string> precision_idents;
+    precision_selected(opts, precision_idents, fft_f32, fft_f64,
+#if FFT_HAVE_FLOAT16
+                       fft_f16,
+#endif
+                       fft_q15, fft_q31);
+    auto precision_sizes = bench_sizes_in(opts, default_sizes);
+
+    if (!precision_idents.empty() && !precision_sizes.empty()) {
+        std::cout << std::endl << "# sample types, FFTs per second" << std::endl;
+        std::cout << "FFT size";
+        for (auto &ident : precision_idents) {
+            std::cout << ", " << ident;
+        }
+        std::cout << std::endl;
+
+        std::vector<std::vector<float>> precision_errors;
+        for (auto n_points : precision_sizes) {
+            std::vector<float> rates;
+            precision_errors.emplace_back();
+            precision_row(opts, report, n_points, rates, precision_errors.back(), fft_f32, fft_f64,
+#if FFT_HAVE_FLOAT16
+                          fft_f16,
+#endif
+                          fft_q15, fft_q31);
+            print_row(n_points, rates);
+        }
+
+        std::cout << std::endl << "# sample types, relative RMS error against long double" << std::endl;
+        for (size_t i = 0; i < precision_sizes.size(); i++) {
+            print_row(precision_sizes[i], precision_errors[i]);
+        }
     }
 #endif
 
@@ -128,7 +899,10 @@ int main() {
 
     return r != 42;
 #else
-    return 0;
+    std::cout << std::endl;
+    dispatch.print(std::cout);
+
+    return report.write() ? 1 : 0;
 #endif
 }
 
@@ -0,0 +1,211 @@
+#include "stft.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+/*
+ * Streaming short-time FFT
+ */
+void STFTStream::make_window(STFTWindow type, size_t count, fval_t *output) {
+    /* Periodic windows, so overlapped frames at hop = count / 2 (Hann) or
+     * count / 3 (Blackman) sum to a constant */
+    for (size_t i = 0; i < count; i++) {
+        auto x = 2.0 * M_PI * (double)i / (double)count;
+        switch (type) {
+        case STFTWindow::Hann:
+            output[i] = (fval_t)(0.5 - 0.5 * std::cos(x));
+            break;
+        case STFTWindow::Blackman:
+            output[i] = (fval_t)(0.42 - 0.5 * std::cos(x) + 0.08 * std::cos(2 * x));
+            break;
+        default:
+            output[i] = 1;
+            break;
+        }
+    }
+}
+
+STFTStream::STFTStream(FFTProvider &provider, size_t frame_size, size_t hop, STFTWindow window,
+                       sink_t sink, size_t queue_frames) :
+provider(provider), frame_size(frame_size), hop(hop), sink(sink) {
+    if (queue_frames == 0) {
+        queue_frames = 1;
+    }
+
+    /* The real transform needs a power of two of at least 2, and a zero hop
+     * would never advance. Such a stream starts closed, push() fails and
+     * finish() returns the error */
+    if ((frame_size < 2) || (frame_size & (frame_size - 1)) || (hop == 0)) {
+        this->error = -1;
+        this->closing = true;
+        this->transform_done = true;
+        return;
+    }
+
+    this->window.resize(frame_size);
+    make_window(window, frame_size, this->window.data());
+
+    /* Room for one frame plus enough hops to keep the transform thread busy
+     * while the producer refills */
+    size_t capacity = 1;
+    while (capacity < std::max(frame_size * 2, frame_size + hop * queue_frames)) {
+        capacity <<= 1;
+    }
+    this->samples.resize(capacity);
+    this->complete_at.resize((capacity - frame_size) / hop + 1);
+
+    this->n_slots = queue_frames;
+    this->spectra.resize(queue_frames * this->bins());
+    this->ready_at.resize(queue_frames);
+
+    this->transform_thread = std::thread(&STFTStream::transform_main, this);
+    this->output_thread = std::thread(&STFTStream::output_main, this);
+}
+
+STFTStream::~STFTStream() {
+    this->finish();
+}
+
+int STFTStream::push(const fval_t *input, size_t count) {
+    auto capacity = this->samples.size();
+
+    while (count) {
+        std::unique_lock<std::mutex> guard(this->lock);
+
+        /* With hop > frame_size the reader can be ahead of the writer, the
+         * skipped samples are written but never read */
+        auto used = [&]() {
+            return (this->samples_written > this->samples_read) ?
+                   this->samples_written - this->samples_read : 0;
+        };
+        this->changed.wait(guard, [&]() { return this->closing || (used() < capacity); });
+        if (this->closing) {
+            return -1;
+        }
+
+        auto n = std::min(count, capacity - used());
+        auto pos = this->samples_written & (capacity - 1);
+        auto first = std::min(n, capacity - pos);
+        std::copy(input, input + first, this->samples.data() + pos);
+        std::copy(input + first, input + n, this->samples.data());
+
+        this->samples_written += n;
+        input += n;
+        count -= n;
+
+        auto now = std::chrono::high_resolution_clock::now();
+        while (this->frames_complete * this->hop + this->frame_size <= this->samples_written) {
+            this->complete_at[this->frames_complete % this->complete_at.size()] = now;
+            this->frames_complete++;
+        }
+
+        guard.unlock();
+        this->changed.notify_all();
+    }
+
+    return 0;
+}
+
+void STFTStream::transform_main() {
+    auto capacity = this->samples.size();
+    auto n_bins = this->bins();
+    std::vector<fval_t> frame(this->frame_size);
+
+    while (true) {
+        std::unique_lock<std::mutex> guard(this->lock);
+        auto complete = [&]() { return this->samples_written >= this->samples_read + this->frame_size; };
+        auto slot_free = [&]() { return this->frames_written - this->frames_read < this->n_slots; };
+        this->changed.wait(guard, [&]() {
+            return (this->closing || complete()) && slot_free();
+        });
+        if (!complete()) {
+            break;
+        }
+
+        auto start = this->samples_read;
+        auto index = this->frames_written;
+        auto ready = this->complete_at[index % this->complete_at.size()];
+        guard.unlock();
+
+        /* The producer never overwrites unread samples and the output thread
+         * never reads a free slot, so both copies run without the lock */
+        for (size_t i = 0; i < this->frame_size; i++) {
+            frame[i] = this->samples[(start + i) & (capacity - 1)] * this->window[i];
+        }
+
+        auto slot = index % this->n_slots;
+        auto res = this->provider.rfft(this->frame_size, frame.data(), this->spectra.data() + slot * n_bins);
+
+        guard.lock();
+        if (res) {
+            this->error = -1;
+            this->closing = true;
+            break;
+        }
+        this->ready_at[slot] = ready;
+        this->frames_written++;
+        this->samples_read += this->hop;
+        guard.unlock();
+        this->changed.notify_all();
+    }
+
+    std::lock_guard<std::mutex> guard(this->lock);
+    this->transform_done = true;
+    this->changed.notify_all();
+}
+
+void STFTStream::output_main() {
+    auto n_bins = this->bins();
+
+    while (true) {
+        std::unique_lock<std::mutex> guard(this->lock);
+        this->changed.wait(guard, [&]() {
+            return this->transform_done || (this->frames_written > this->frames_read);
+        });
+        if (this->frames_written == this->frames_read) {
+            break;
+        }
+
+        auto index = this->frames_read;
+        auto slot = index % this->n_slots;
+        guard.unlock();
+
+        this->sink(index, this->spectra.data() + slot * n_bins, n_bins);
+
+        auto end = std::chrono::high_resolution_clock::now();
+        uint64_t latency = std::chrono::duration_cast<std::chrono::nanoseconds>(end - this->ready_at[slot]).count();
+        this->latency_sum += latency;
+        if (latency > this->latency_max) {
+            this->latency_max = latency;
+        }
+
+        guard.lock();
+        this->frames_read++;
+        guard.unlock();
+        this->changed.notify_all();
+    }
+}
+
+int STFTStream::finish() {
+    {
+        std::lock_guard<std::mutex> guard(this->lock);
+        this->closing = true;
+    }
+    this->changed.notify_all();
+
+    if (this->transform_thread.joinable()) {
+        this->transform_thread.join();
+    }
+    if (this->output_thread.joinable()) {
+        this->output_thread.join();
+    }
+
+    return this->error;
+}
+
+float STFTStream::latency_mean_us() const {
+    if (this->frames_read == 0) {
+        return 0;
+    }
+    return (float)this->latency_sum / (float)this->frames_read / 1e3f;
+}
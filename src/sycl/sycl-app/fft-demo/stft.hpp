@@ -0,0 +1,112 @@
+#ifndef STFT_HPP
+#define STFT_HPP
+
+#include "fft.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+enum class STFTWindow {
+    Rect,
+    Hann,
+    Blackman,
+};
+
+/*
+ * Streaming short-time FFT
+ *
+ * Samples are pushed in arbitrarily sized chunks from the caller's thread into
+ * a bounded sample ring. A transform thread cuts windowed frames of
+ * `frame_size` samples every `hop` samples and runs the real transform with the
+ * given provider, writing frame_size / 2 + 1 bins into a bounded ring of
+ * spectra. An output thread hands each spectrum to the sink in frame order.
+ * Both rings block their producer when full, so a slow sink throttles the
+ * input instead of letting latency grow. Nothing is allocated per frame.
+ */
+class STFTStream {
+public:
+    typedef std::function<void(size_t frame, const cfval_t *bins, size_t n_bins)> sink_t;
+
+private:
+    FFTProvider &provider;
+    size_t frame_size;
+    size_t hop;
+    sink_t sink;
+
+    std::vector<fval_t> window;
+
+    /* Sample ring, positions are absolute sample counts */
+    std::vector<fval_t> samples;
+    size_t samples_written = 0;
+    size_t samples_read = 0;
+
+    /* When the last sample of each frame was pushed, indexed by frame number
+     * modulo its size. Frames complete ahead of the transform thread are
+     * bounded by the sample ring, so it never wraps onto a pending frame */
+    std::vector<std::chrono::high_resolution_clock::time_point> complete_at;
+    size_t frames_complete = 0;
+
+    /* Spectrum ring, positions are absolute frame numbers */
+    std::vector<cfval_t> spectra;
+    std::vector<std::chrono::high_resolution_clock::time_point> ready_at;
+    size_t n_slots;
+    size_t frames_written = 0;
+    size_t frames_read = 0;
+
+    std::mutex lock;
+    std::condition_variable changed;
+    bool closing = false;
+    bool transform_done = false;
+    int error = 0;
+
+    /* Frame latency from the last sample of a frame being pushed to its sink
+     * call, in nanoseconds, so time spent queued behind earlier frames
+     * counts */
+    std::atomic<uint64_t> latency_max{0};
+    std::atomic<uint64_t> latency_sum{0};
+
+    std::thread transform_thread;
+    std::thread output_thread;
+
+    void transform_main();
+    void output_main();
+
+public:
+    /* `queue_frames` bounds the number of spectra waiting for the sink.
+     * `frame_size` must be a power of two of at least 2 and `hop` non-zero,
+     * otherwise the stream is invalid, see ok() */
+    STFTStream(FFTProvider &provider, size_t frame_size, size_t hop, STFTWindow window,
+               sink_t sink, size_t queue_frames = 8);
+    ~STFTStream();
+
+    STFTStream(const STFTStream &) = delete;
+    STFTStream &operator=(const STFTStream &) = delete;
+
+    /* Append samples, blocks while the sample ring is full. Returns -1 once
+     * the stream has failed or been finished */
+    int push(const fval_t *input, size_t count);
+
+    /* Emit every complete frame still queued and stop the threads. Samples
+     * that do not fill a whole frame are dropped */
+    int finish();
+
+    /* False when the sizes were rejected, or after finish() when a transform
+     * failed */
+    bool ok() const { return !this->error; }
+
+    size_t bins() const { return this->frame_size / 2 + 1; }
+    size_t frames() const { return this->frames_read; }
+    float latency_max_us() const { return (float)this->latency_max / 1e3f; }
+    float latency_mean_us() const;
+
+    static void make_window(STFTWindow type, size_t count, fval_t *output);
+};
+
+#endif
@@ -0,0 +1,271 @@
+#include "gemm.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+#if (defined(__x86_64__) || defined(__i386__)) && !defined(__SYCL_DEVICE_ONLY__)
+#  define GEMM_X86 1
+#else
+#  define GEMM_X86 0
+#endif
+
+/* Micro-kernel tile, GEMM_MR rows by GEMM_NR columns of C. 6 x 16 keeps 12
+ * AVX2 accumulators in flight, enough to cover the multiply latency */
+#define GEMM_MR 6
+#define GEMM_NR 16
+
+/* Cache blocking: a GEMM_KC deep sliver of B stays in L1, a GEMM_MC x GEMM_KC
+ * block of A in L2 and a GEMM_KC x GEMM_NC panel of B in L3 */
+#define GEMM_KC 256
+#define GEMM_MC 96
+#define GEMM_NC 4096
+
+/* Columns of a panel per task, a multiple of GEMM_NR */
+#define GEMM_TASK_COLS 512
+
+/* Slivers packed per packing task */
+#define GEMM_PACK_SLIVERS 16
+
+typedef mtype_t v4si_t  __attribute__((vector_size(16)));
+typedef mtype_t v8si_t  __attribute__((vector_size(32)));
+typedef mtype_t v16si_t __attribute__((vector_size(64)));
+
+typedef void (*gemm_kernel_fn)(size_t kc, const mtype_t *ap, const mtype_t *bp,
+                               mtype_t *c, size_t ldc, bool accumulate);
+
+/* C[MR x NR] (+)= A sliver * B sliver. V is a vector of W = sizeof(V) /
+ * sizeof(mtype_t) lanes, or mtype_t itself for the scalar kernel. Only vector
+ * locals are used so the ABI does not depend on the caller's ISA */
+template <typename V>
+static inline __attribute__((always_inline))
+void _gemm_kernel(size_t kc, const mtype_t *ap, const mtype_t *bp,
+                  mtype_t *c, size_t ldc, bool accumulate) {
+    constexpr size_t W = sizeof(V) / sizeof(mtype_t);
+    constexpr size_t NV = GEMM_NR / W;
+
+    V acc[GEMM_MR][NV];
+    for (size_t r = 0; r < GEMM_MR; r++) {
+        for (size_t v = 0; v < NV; v++) {
+            acc[r][v] = V{} + 0;
+        }
+    }
+
+    for (size_t k = 0; k < kc; k++) {
+        V bv[NV];
+        for (size_t v = 0; v < NV; v++) {
+            std::memcpy(&bv[v], bp + k * GEMM_NR + v * W, sizeof(V));
+        }
+        for (size_t r = 0; r < GEMM_MR; r++) {
+            V av = V{} + ap[k * GEMM_MR + r];
+            for (size_t v = 0; v < NV; v++) {
+                acc[r][v] += av * bv[v];
+            }
+        }
+    }
+
+    for (size_t r = 0; r < GEMM_MR; r++) {
+        for (size_t v = 0; v < NV; v++) {
+            auto dst = c + r * ldc + v * W;
+            if (accumulate) {
+                V prev;
+                std::memcpy(&prev, dst, sizeof(V));
+                acc[r][v] += prev;
+            }
+            std::memcpy(dst, &acc[r][v], sizeof(V));
+        }
+    }
+}
+
+static void _gemm_kernel_scalar(size_t kc, const mtype_t *ap, const mtype_t *bp,
+                                mtype_t *c, size_t ldc, bool accumulate) {
+    _gemm_kernel<mtype_t>(kc, ap, bp, c, ldc, accumulate);
+}
+
+#if GEMM_X86
+__attribute__((target("sse4.1")))
+static void _gemm_kernel_sse(size_t kc, const mtype_t *ap, const mtype_t *bp,
+                             mtype_t *c, size_t ldc, bool accumulate) {
+    _gemm_kernel<v4si_t>(kc, ap, bp, c, ldc, accumulate);
+}
+
+__attribute__((target("avx2")))
+static void _gemm_kernel_avx2(size_t kc, const mtype_t *ap, const mtype_t *bp,
+                              mtype_t *c, size_t ldc, bool accumulate) {
+    _gemm_kernel<v8si_t>(kc, ap, bp, c, ldc, accumulate);
+}
+
+__attribute__((target("avx512f")))
+static void _gemm_kernel_avx512(size_t kc, const mtype_t *ap, const mtype_t *bp,
+                                mtype_t *c, size_t ldc, bool accumulate) {
+    _gemm_kernel<v16si_t>(kc, ap, bp, c, ldc, accumulate);
+}
+#endif /* GEMM_X86 */
+
+/* Rows [row, row + GEMM_MR) and columns [col, col + kc) of A as one sliver,
+ * column-major within the sliver. Rows past the matrix are zero */
+static void _pack_a(size_t len, const mtype_t *a, size_t row, size_t col, size_t kc, mtype_t *ap) {
+    auto rows = std::min<size_t>(GEMM_MR, len - row);
+    for (size_t k = 0; k < kc; k++) {
+        for (size_t r = 0; r < rows; r++) {
+            ap[k * GEMM_MR + r] = a[(row + r) * len + col + k];
+        }
+        for (size_t r = rows; r < GEMM_MR; r++) {
+            ap[k * GEMM_MR + r] = 0;
+        }
+    }
+}
+
+/* Rows [row, row + kc) and columns [col, col + GEMM_NR) of B as one sliver,
+ * row-major within the sliver. Columns past the matrix are zero */
+static void _pack_b(size_t len, const mtype_t *b, size_t row, size_t col, size_t kc, mtype_t *bp) {
+    auto cols = std::min<size_t>(GEMM_NR, len - col);
+    for (size_t k = 0; k < kc; k++) {
+        auto src = b + (row + k) * len + col;
+        std::memcpy(bp + k * GEMM_NR, src, cols * sizeof(mtype_t));
+        std::fill(bp + k * GEMM_NR + cols, bp + (k + 1) * GEMM_NR, 0);
+    }
+}
+
+static bool isa_supported(GemmIsa isa) {
+    switch (isa) {
+    case GemmIsa::Scalar:
+        return true;
+#if GEMM_X86
+    case GemmIsa::SSE:
+        return __builtin_cpu_supports("sse4.1");
+    case GemmIsa::AVX2:
+        return __builtin_cpu_supports("avx2");
+    case GemmIsa::AVX512:
+        return __builtin_cpu_supports("avx512f");
+#endif
+    default:
+        return false;
+    }
+}
+
+GemmIsa MatrixMultBlocked::detect() {
+    for (auto isa : {GemmIsa::AVX512, GemmIsa::AVX2, GemmIsa::SSE}) {
+        if (isa_supported(isa)) {
+            return isa;
+        }
+    }
+    return GemmIsa::Scalar;
+}
+
+MatrixMultBlocked::MatrixMultBlocked(ThreadPool &pool, GemmIsa isa) : pool(pool) {
+    if ((isa == GemmIsa::Auto) || !isa_supported(isa)) {
+        isa = detect();
+    }
+    this->isa = isa;
+}
+
+std::string MatrixMultBlocked::ident() {
+    std::string base = (this->pool.concurrency() > 1) ? "mt_cpu" : "st_cpu";
+    switch (this->isa) {
+    case GemmIsa::SSE:
+        return base + "_sse";
+    case GemmIsa::AVX2:
+        return base + "_avx2";
+    case GemmIsa::AVX512:
+        return base + "_avx512";
+    default:
+        return base + "_scalar";
+    }
+}
+
+void MatrixMultBlocked::multiply(size_t len, const mtype_t *a, const mtype_t *b, mtype_t *out) {
+    if (len == 0) {
+        return;
+    }
+
+    gemm_kernel_fn kernel = _gemm_kernel_scalar;
+#if GEMM_X86
+    switch (this->isa) {
+    case GemmIsa::SSE:
+        kernel = _gemm_kernel_sse;
+        break;
+    case GemmIsa::AVX2:
+        kernel = _gemm_kernel_avx2;
+        break;
+    case GemmIsa::AVX512:
+        kernel = _gemm_kernel_avx512;
+        break;
+    default:
+        break;
+    }
+#endif
+
+    auto a_slivers = (len + GEMM_MR - 1) / GEMM_MR;
+    auto b_slivers_max = (std::min<size_t>(len, GEMM_NC) + GEMM_NR - 1) / GEMM_NR;
+    this->a_pack.resize(a_slivers * GEMM_MR * GEMM_KC);
+    this->b_pack.resize(b_slivers_max * GEMM_NR * GEMM_KC);
+    auto a_pack = this->a_pack.data();
+    auto b_pack = this->b_pack.data();
+
+    for (size_t jc = 0; jc < len; jc += GEMM_NC) {
+        auto nc = std::min<size_t>(GEMM_NC, len - jc);
+        auto b_slivers = (nc + GEMM_NR - 1) / GEMM_NR;
+
+        for (size_t pc = 0; pc < len; pc += GEMM_KC) {
+            auto kc = std::min<size_t>(GEMM_KC, len - pc);
+
+            /* Pack this panel of B and every row of A for the same k range,
+             * A is packed whole so the tasks below only read */
+            auto b_tasks = (b_slivers + GEMM_PACK_SLIVERS - 1) / GEMM_PACK_SLIVERS;
+            auto a_tasks = (a_slivers + GEMM_PACK_SLIVERS - 1) / GEMM_PACK_SLIVERS;
+            this->pool.parallel_for(b_tasks + a_tasks, [&](size_t t) {
+                if (t < b_tasks) {
+                    auto last = std::min(b_slivers, (t + 1) * GEMM_PACK_SLIVERS);
+                    for (auto s = t * GEMM_PACK_SLIVERS; s < last; s++) {
+                        _pack_b(len, b, pc, jc + s * GEMM_NR, kc, b_pack + s * GEMM_NR * kc);
+                    }
+                } else {
+                    t -= b_tasks;
+                    auto last = std::min(a_slivers, (t + 1) * GEMM_PACK_SLIVERS);
+                    for (auto s = t * GEMM_PACK_SLIVERS; s < last; s++) {
+                        _pack_a(len, a, s * GEMM_MR, pc, kc, a_pack + s * GEMM_MR * kc);
+                    }
+                }
+            });
+
+            /* First k block overwrites C, later ones accumulate */
+            auto accumulate = pc > 0;
+
+            auto row_blocks = (len + GEMM_MC - 1) / GEMM_MC;
+            auto col_chunks = (nc + GEMM_TASK_COLS - 1) / GEMM_TASK_COLS;
+            this->pool.parallel_for(row_blocks * col_chunks, [&](size_t t) {
+                auto ic = (t / col_chunks) * GEMM_MC;
+                auto mc = std::min<size_t>(GEMM_MC, len - ic);
+                auto j0 = (t % col_chunks) * GEMM_TASK_COLS;
+                auto j1 = std::min<size_t>(nc, j0 + GEMM_TASK_COLS);
+
+                for (auto jr = j0; jr < j1; jr += GEMM_NR) {
+                    auto bp = b_pack + (jr / GEMM_NR) * GEMM_NR * kc;
+                    auto nr = std::min<size_t>(GEMM_NR, nc - jr);
+
+                    for (size_t ir = 0; ir < mc; ir += GEMM_MR) {
+                        auto ap = a_pack + ((ic + ir) / GEMM_MR) * GEMM_MR * kc;
+                        auto mr = std::min<size_t>(GEMM_MR, mc - ir);
+                        auto c = out + (ic + ir) * len + jc + jr;
+
+                        if ((mr == GEMM_MR) && (nr == GEMM_NR)) {
+                            kernel(kc, ap, bp, c, len, accumulate);
+                            continue;
+                        }
+
+                        /* Edge tile, run in full on a local tile and copy
+                         * back the part inside the matrix */
+                        mtype_t tile[GEMM_MR * GEMM_NR];
+                        kernel(kc, ap, bp, tile, GEMM_NR, false);
+                        for (size_t r = 0; r < mr; r++) {
+                            for (size_t j = 0; j < nr; j++) {
+                                auto &dst = c[r * len + j];
+                                dst = accumulate ? dst + tile[r * GEMM_NR + j] : tile[r * GEMM_NR + j];
+                            }
+                        }
+                    }
+                }
+            });
+        }
+    }
+}
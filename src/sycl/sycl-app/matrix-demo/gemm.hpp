@@ -0,0 +1,57 @@
+#ifndef GEMM_HPP
+#define GEMM_HPP
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include "common/thread_pool.hpp"
+
+typedef int mtype_t;
+
+/* Instruction sets usable by MatrixMultBlocked */
+enum class GemmIsa {
+    Auto,
+    Scalar,
+    SSE,
+    AVX2,
+    AVX512,
+};
+
+/*
+ * Cache-blocked CPU matrix multiply
+ *
+ * Goto/BLIS style: B is packed a KC x NC panel at a time into NR-column
+ * slivers sized to stay in L3, A into MR-row slivers of KC, and a
+ * register-blocked MR x NR micro-kernel runs over the packed slivers with the
+ * whole C tile held in vector registers. The micro-kernel is written once with
+ * GCC/Clang vector extensions and compiled per ISA through target attributes,
+ * the ISA is chosen at runtime.
+ *
+ * Each (MC row block, column chunk) pair of a panel is an independent task on
+ * the pool, a pool without workers runs them all on the calling thread.
+ * Packing buffers are kept between calls.
+ */
+class MatrixMultBlocked {
+private:
+    GemmIsa isa;
+    ThreadPool &pool;
+
+    std::vector<mtype_t> a_pack;
+    std::vector<mtype_t> b_pack;
+
+public:
+    /* Tasks run on `pool`, which is shared and not owned, a pool without
+     * workers makes it single threaded */
+    MatrixMultBlocked(ThreadPool &pool, GemmIsa isa = GemmIsa::Auto);
+
+    /* Best instruction set the running CPU supports */
+    static GemmIsa detect();
+
+    std::string ident();
+
+    /* out = a * b, all `len` x `len` and row-major */
+    void multiply(size_t len, const mtype_t *a, const mtype_t *b, mtype_t *out);
+};
+
+#endif
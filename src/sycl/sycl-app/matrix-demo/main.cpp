@@ -1,108 +1,352 @@
+#include <algorithm>
 #include <chrono>
 #include <cmath>
 
 #include <cstring>
+#include <functional>
+#include <limits>
+#include <string>
 #include <sycl/sycl.hpp>
+#include <vector>
 
-class scalar_add;
+#include "common/bench.hpp"
+#include "common/dispatch.hpp"
+#include "common/hetero.hpp"
+#include "common/pipeline.hpp"
+#include "gemm.hpp"
 
-typedef int mtype_t;
+class scalar_add;
 
 /* All matrices are x-by-x to simplify code */
 #define MAT_SZ_MIN 8
 #define MAT_SZ_MAX 4096
 #define MAT_SZ_STEP(sz) ((sz) * 2)
 
+/* Pipelined SYCL runs enqueue REPEAT_COUNT multiplications back to back and
+ * report the sustained time per multiplication, the other SYCL columns are the
+ * latency of a single one including its transfers */
 #define REPEAT_COUNT 8
 
+/* CPU samples repeat the multiplication REPEAT_COUNT times or until about
+ * CPU_SAMPLE_OPS operations, whichever is fewer, but at least once */
+#define CPU_SAMPLE_OPS (1ull << 33)
+
+/* Harness defaults, each sample is REPEAT_COUNT multiplications */
+#define BENCH_WARMUP 1
+#define BENCH_REPEAT 20
+
+/* A column stops once a multiplication takes longer than MAT_SKIP_NS at the
+ * median, larger sizes are reported as SKIP */
+#define MAT_SKIP_NS 1e9
+
+/* Tiled SYCL kernel: each work-group computes a MAT_TILE x MAT_TILE block of
+ * the output, stepping through k MAT_TILE_K at a time with both input tiles
+ * staged in local memory. Each work-item accumulates MAT_REG x MAT_REG outputs
+ * in registers, so a work-group has (MAT_TILE / MAT_REG)^2 work-items. Devices
+ * that cannot run a work-group that large use the naive kernel */
+#define MAT_TILE 64
+#define MAT_TILE_K 16
+#define MAT_REG 4
+
 #define SYCL_USE_GPU 1
 #define SYCL_USE_CPU 1
 
-#if SYCL_USE_GPU && SYCL_USE_CPU
-/* If we have both GPU and CPU, we can run both in parallel - this performs
- * better until we get to 1024+ */
+#if SYCL_USE_CPU
+/* Split runs spread each multiplication over the GPU and CPU in proportion to
+ * their measured throughput, or over the NUMA domains of the CPU when there is
+ * no GPU */
 #  define SYCL_USE_X2 1
 #else
 #  define SYCL_USE_X2 0
 #endif
 
+/* --verify checks every column against a naive product at these sizes, none a
+ * multiple of the tiles or blocks */
+#define VERIFY_SIZES {17, 100, 257}
+
 #define MARK_USED(d) { asm volatile ("" :: "g" (d)); }
 
 
 static void display_devices();
-static float matrix_mult_st_cpu(size_t runs, size_t len, const mtype_t *a, const mtype_t *b, mtype_t *out);
-static float matrix_mult_sycl(sycl::queue &q, size_t runs, size_t len,const mtype_t *a, const mtype_t *b, mtype_t *out);
+static void matrix_mult_reference(size_t len, const mtype_t *a, const mtype_t *b, mtype_t *out);
+static int verify_row(size_t len, const std::string &algo, const std::string &device, const mtype_t *ref, const mtype_t *out);
+/* Plain triple loop, the reference for --verify */
+static void matrix_mult_reference(size_t len, const mtype_t *a, const mtype_t *b, mtype_t *out) {
+    for (size_t i = 0; i < len; i++) {
+        for (size_t j = 0; j < len; j++) {
+            mtype_t sum = 0;
+            for (size_t k = 0; k < len; k++) {
+                sum += a[i*len + k] * b[k*len + j];
+            }
+            out[i*len + j] = sum;
+        }
+    }
+}
+
+/* One row of the --verify table, returns 1 if `out` differs from `ref` */
+static int verify_row(size_t len, const std::string &algo, const std::string &device, const mtype_t *ref, const mtype_t *out) {
+    size_t mismatches = 0;
+    for (size_t i = 0; i < len * len; i++) {
+        if (out[i] != ref[i]) {
+            mismatches++;
+        }
+    }
+    std::cout << len << ", " << algo << ", " << device << ", " << mismatches
+              << ", " << (mismatches ? "FAIL" : "ok") << std::endl;
+    return mismatches ? 1 : 0;
+}
+
+static float matrix_mult_cpu(MatrixMultBlocked &gemm, size_t runs, size_t len, const mtype_t *a, const mtype_t *b, mtype_t *out);
+static float matrix_mult_sycl(sycl::queue &q, bool tiled, size_t runs, size_t len, const mtype_t *a, const mtype_t *b, mtype_t *out);
 #if SYCL_USE_X2
-static float matrix_mult_sycl_x2(sycl::queue &q1, sycl::queue &q2, size_t runs, size_t len, const mtype_t *a, const mtype_t *b, mtype_t *out);
+static float matrix_mult_sycl_x2(HeteroScheduler &sched, size_t runs, size_t len, const mtype_t *a, const mtype_t *b, mtype_t *out);
 #endif
 
 
 
-int main() {
+int main(int argc, char **argv) {
+    BenchOptions opts;
+    opts.warmup = BENCH_WARMUP;
+    opts.repeat = BENCH_REPEAT;
+    auto args = bench_parse_args(argc, argv, opts);
+    if (args) {
+        return (args < 0) ? 1 : 0;
+    }
+
     display_devices();
 
+    /* Queues are only created for the selected devices, so a machine without
+     * a GPU can still run the CPU columns */
 #if SYCL_USE_GPU
-    auto sycl_gpu = sycl::queue{sycl::gpu_selector_v};
-    std::cerr << "Chosen SYCL GPU device: "
-              << sycl_gpu.get_device().get_info<sycl::info::device::name>()
-              << std::endl << std::endl;
+    auto use_gpu = bench_device_selected(opts, "gpu");
+    sycl::queue sycl_gpu;
+    if (use_gpu) {
+        sycl_gpu = sycl::queue{sycl::gpu_selector_v};
+        std::cerr << "Chosen SYCL GPU device: "
+                  << sycl_gpu.get_device().get_info<sycl::info::device::name>()
+                  << std::endl << std::endl;
+    }
 #endif
 
 #if SYCL_USE_CPU
-    auto sycl_cpu = sycl::queue{sycl::cpu_selector_v};
-
-    std::cerr << "Chosen SYCL CPU device: "
-              << sycl_cpu.get_device().get_info<sycl::info::device::name>()
-              << std::endl << std::endl;
+    auto use_cpu = bench_device_selected(opts, "cpu");
+    sycl::queue sycl_cpu;
+    if (use_cpu) {
+        sycl_cpu = sycl::queue{sycl::cpu_selector_v};
+        std::cerr << "Chosen SYCL CPU device: "
+                  << sycl_cpu.get_device().get_info<sycl::info::device::name>()
+                  << std::endl << std::endl;
+    }
 #endif
 
-    /* Setup input and output buffers */
+    /* Setup input and output buffers. Inputs are small and deterministic, so
+     * no product of up to MAT_SZ_MAX terms overflows */
     auto mat_a   = new mtype_t[MAT_SZ_MAX*MAT_SZ_MAX];
     auto mat_b   = new mtype_t[MAT_SZ_MAX*MAT_SZ_MAX];
     auto mat_out = new mtype_t[MAT_SZ_MAX*MAT_SZ_MAX];
+    for (size_t i = 0; i < (size_t)MAT_SZ_MAX*MAT_SZ_MAX; i++) {
+        mat_a[i] = (mtype_t)(i % 17) - 8;
+        mat_b[i] = (mtype_t)((i * 5) % 13) - 6;
+    }
 
-    std::cout << "# units for runtime in nanoseconds per iteration" << std::endl;
-    std::cout << "matrix size, single threaded CPU"
+    /* One column per algorithm and device, `stopped_at` is the size at which
+     * it exceeded MAT_SKIP_NS */
+    struct Column {
+        std::string algo;
+        std::string device;
+        std::string title;
+        std::function<float(size_t)> run;
+        size_t stopped_at = 0;
+    };
+    std::vector<Column> columns;
+
+    /* One pool for every multithreaded column, and one without workers that
+     * runs everything on the calling thread */
+    ThreadPool pool(-1);
+    ThreadPool inline_pool(0);
+    MatrixMultBlocked gemm_st(inline_pool);
+    MatrixMultBlocked gemm_mt(pool);
+    auto cpu_runs = [](size_t len) {
+        return std::max<size_t>(1, std::min<size_t>(REPEAT_COUNT, CPU_SAMPLE_OPS / (2ull * len * len * len)));
+    };
+
+    if (bench_algo_selected(opts, "st_cpu")) {
+        columns.push_back({"st_cpu", "host", "single threaded CPU", [&](size_t len) {
+            return matrix_mult_cpu(gemm_st, cpu_runs(len), len, mat_a, mat_b, mat_out);
+        }});
+    }
+    if (bench_algo_selected(opts, "mt_cpu")) {
+        columns.push_back({"mt_cpu", "host", "multithreaded CPU", [&](size_t len) {
+            return matrix_mult_cpu(gemm_mt, cpu_runs(len), len, mat_a, mat_b, mat_out);
+        }});
+    }
 #if SYCL_USE_GPU
-              << ", sycl GPU"
+    if (use_gpu && bench_algo_selected(opts, "sycl_naive")) {
+        columns.push_back({"sycl_naive", "gpu", "naive sycl GPU", [&](size_t len) {
+            return matrix_mult_sycl(sycl_gpu, false, 1, len, mat_a, mat_b, mat_out);
+        }});
+    }
+    if (use_gpu && bench_algo_selected(opts, "sycl")) {
+        columns.push_back({"sycl", "gpu", "sycl GPU", [&](size_t len) {
+            return matrix_mult_sycl(sycl_gpu, true, 1, len, mat_a, mat_b, mat_out);
+        }});
+    }
+    if (use_gpu && bench_algo_selected(opts, "sycl_pipe")) {
+        columns.push_back({"sycl_pipe", "gpu", "sycl GPU pipelined", [&](size_t len) {
+            return matrix_mult_sycl(sycl_gpu, true, REPEAT_COUNT, len, mat_a, mat_b, mat_out);
+        }});
+    }
 #endif
 #if SYCL_USE_CPU
-              << ", sycl CPU"
+    if (use_cpu && bench_algo_selected(opts, "sycl_naive")) {
+        columns.push_back({"sycl_naive", "cpu", "naive sycl CPU", [&](size_t len) {
+            return matrix_mult_sycl(sycl_cpu, false, 1, len, mat_a, mat_b, mat_out);
+        }});
+    }
+    if (use_cpu && bench_algo_selected(opts, "sycl")) {
+        columns.push_back({"sycl", "cpu", "sycl CPU", [&](size_t len) {
+            return matrix_mult_sycl(sycl_cpu, true, 1, len, mat_a, mat_b, mat_out);
+        }});
+    }
+    if (use_cpu && bench_algo_selected(opts, "sycl_pipe")) {
+        columns.push_back({"sycl_pipe", "cpu", "sycl CPU pipelined", [&](size_t len) {
+            return matrix_mult_sycl(sycl_cpu, true, REPEAT_COUNT, len, mat_a, mat_b, mat_out);
+        }});
+    }
 #endif
 #if SYCL_USE_X2
-              << ", sycl GPU+CPU"
+    /* Row bands are whole output tiles of the tiled kernel */
+    HeteroScheduler hetero(MAT_TILE);
+    std::string hetero_device = "cpu_numa";
+#if SYCL_USE_GPU
+    if (use_gpu && use_cpu) {
+        hetero.add(sycl_gpu, "gpu");
+        hetero.add(sycl_cpu, "cpu");
+        hetero_device = "gpu+cpu";
+    }
+#endif
+    if (use_cpu && (hetero.size() == 0)) {
+        auto cpu_queues = hetero_cpu_queues(sycl_cpu.get_device());
+        for (auto i = 0; i < cpu_queues.size(); i++) {
+            hetero.add(cpu_queues[i], "cpu" + std::to_string(i));
+        }
+    }
+    if ((hetero.size() > 1) && bench_algo_selected(opts, "sycl_x2")) {
+        columns.push_back({"sycl_x2", hetero_device, "sycl split " + hetero_device, [&](size_t len) {
+            return matrix_mult_sycl_x2(hetero, REPEAT_COUNT, len, mat_a, mat_b, mat_out);
+        }});
+    }
 #endif
-              << std::endl;
 
+    std::vector<size_t> default_sizes;
     for (auto len = MAT_SZ_MIN; len <= MAT_SZ_MAX; len = MAT_SZ_STEP(len)) {
-        std::cout << len;
+        default_sizes.push_back(len);
+    }
 
-        if (len > 512) {
-            std::cout << ", SKIP";
-        } else {
-            auto rt_st_cpu   = matrix_mult_st_cpu(REPEAT_COUNT, len, mat_a, mat_b, mat_out);
-            std::cout << ", " << rt_st_cpu;
+    /* --verify checks results instead of timing. Every column runs once per
+     * size against the naive product, and the single threaded GEMM once per
+     * instruction set the CPU supports. The dispatch columns only choose
+     * between st_cpu and sycl_pipe, so they are not calibrated here */
+    if (opts.verify) {
+        std::vector<mtype_t> ref;
+        auto failures = 0;
+
+        std::cout << "matrix size, algo, device, mismatches, result" << std::endl;
+        for (auto len : bench_sizes(opts, VERIFY_SIZES)) {
+            if (len > MAT_SZ_MAX) {
+                continue;
+            }
+            ref.resize(len * len);
+            matrix_mult_reference(len, mat_a, mat_b, ref.data());
+
+            for (auto isa = GemmIsa::Scalar; isa <= MatrixMultBlocked::detect();
+                 isa = (GemmIsa)((int)isa + 1)) {
+                MatrixMultBlocked gemm(inline_pool, isa);
+                if (!bench_algo_selected(opts, "st_cpu") && !bench_algo_selected(opts, gemm.ident())) {
+                    continue;
+                }
+                std::fill(mat_out, mat_out + len * len, std::numeric_limits<mtype_t>::max());
+                gemm.multiply(len, mat_a, mat_b, mat_out);
+                failures += verify_row(len, gemm.ident(), "host", ref.data(), mat_out);
+            }
+            for (auto &col : columns) {
+                std::fill(mat_out, mat_out + len * len, std::numeric_limits<mtype_t>::max());
+                col.run(len);
+                failures += verify_row(len, col.algo, col.device, ref.data(), mat_out);
+            }
         }
+
+        std::cout << std::endl << "# " << failures << " failed" << std::endl;
+        return failures ? 1 : 0;
+    }
+
+    BenchReport report("matrix-demo", opts);
+
+    /* Dispatch columns multiply small matrices inline on the host and larger
+     * ones pipelined on the device, from the crossover calibrated here */
+    SyclDispatch dispatch;
+    auto add_dispatch = [&](sycl::queue &q, const std::string &device, const std::string &title) {
+        auto dev = dispatch.add_device(q, device);
+        report.add("launch", device, 0, dispatch.launch_overhead(dev), 0, 0);
+        if (!bench_algo_selected(opts, "sycl_auto")) {
+            return;
+        }
+
+        auto host = [&](size_t len) {
+            return (double)matrix_mult_cpu(gemm_st, cpu_runs(len), len, mat_a, mat_b, mat_out);
+        };
+        auto device_path = [&](size_t len) {
+            return (double)matrix_mult_sycl(q, true, REPEAT_COUNT, len, mat_a, mat_b, mat_out);
+        };
+        auto handle = dispatch.calibrate("mult", dev, default_sizes, host, device_path);
+        columns.push_back({"sycl_auto", device, title, [&, handle, host, device_path](size_t len) {
+            return (float)(dispatch.on_device(handle, len) ? device_path(len) : host(len));
+        }});
+    };
 #if SYCL_USE_GPU
-        auto rt_sycl_gpu = matrix_mult_sycl(sycl_gpu, REPEAT_COUNT, len, mat_a, mat_b, mat_out);
-        std::cout << ", " << rt_sycl_gpu;
+    if (use_gpu) {
+        add_dispatch(sycl_gpu, "gpu", "dispatch GPU");
+    }
 #endif
 #if SYCL_USE_CPU
-        if (len > 2048) {
-            std::cout << ", SKIP";
-        } else {
-            auto rt_sycl_cpu = matrix_mult_sycl(sycl_cpu, REPEAT_COUNT, len, mat_a, mat_b, mat_out);
-            std::cout << ", " << rt_sycl_cpu;
-        }
+    if (use_cpu) {
+        add_dispatch(sycl_cpu, "cpu", "dispatch CPU");
+    }
 #endif
-#if SYCL_USE_X2
-        if (len > 2048) {
-            std::cout << ", SKIP";
-        } else {
-            auto rt_sycl_x2 = matrix_mult_sycl_x2(sycl_gpu, sycl_cpu, REPEAT_COUNT, len, mat_a, mat_b, mat_out);
-            std::cout << ", " << rt_sycl_x2;
+
+    std::cout << "# units for runtime in nanoseconds per iteration, median of "
+              << opts.repeat << " samples" << (opts.cold ? ", cold cache" : "") << std::endl;
+    std::cout << "matrix size";
+    for (auto &col : columns) {
+        std::cout << ", " << col.title;
+    }
+    std::cout << std::endl;
+
+    /* Operations per second of each row, printed as a second table */
+    std::vector<std::pair<size_t, std::vector<float>>> rates;
+
+    for (auto len : bench_sizes(opts, default_sizes)) {
+        if (len > MAT_SZ_MAX) {
+            continue;
+        }
+        std::cout << len;
+        rates.push_back({len, {}});
+
+        for (auto &col : columns) {
+            if (col.stopped_at) {
+                std::cout << ", SKIP";
+                rates.back().second.push_back(-1);
+                continue;
+            }
+            auto stats = bench_measure(opts, [&]() -> double { return col.run(len); });
+            std::cout << ", " << (stats.ok ? stats.median : -1);
+            report.add(col.algo, col.device, len, stats,
+                       2.0 * len * len * len, 3.0 * len * len * sizeof(mtype_t));
+            rates.back().second.push_back(stats.ok ? (float)(2.0 * len * len * len / stats.median) : 0);
+            if (stats.ok && (stats.median > MAT_SKIP_NS)) {
+                col.stopped_at = len;
+            }
         }
-#endif
 
         std::cout << std::endl;
 
@@ -110,22 +354,48 @@ int main() {
         MARK_USED(mat_out);
     }
 
-    return 0;
+    std::cout << std::endl << "# GOP/s at the median, a multiply-add counts as two operations" << std::endl;
+    std::cout << "matrix size";
+    for (auto &col : columns) {
+        std::cout << ", " << col.title;
+    }
+    std::cout << std::endl;
+    for (auto &row : rates) {
+        std::cout << row.first;
+        for (auto rate : row.second) {
+            if (rate < 0) {
+                std::cout << ", SKIP";
+            } else {
+                std::cout << ", " << rate;
+            }
+        }
+        std::cout << std::endl;
+    }
+
+#if SYCL_USE_X2
+    if (hetero.size() > 1) {
+        std::cout << std::endl << "# split shares after the last run: " << hetero.shares() << std::endl;
+    }
+#endif
+
+    for (auto &col : columns) {
+        if (col.stopped_at) {
+            std::cout << std::endl << "# " << col.title << " stopped after " << col.stopped_at
+                      << ", over " << MAT_SKIP_NS / 1e9 << " s per multiplication" << std::endl;
+        }
+    }
+
+    std::cout << std::endl;
+    dispatch.print(std::cout);
+
+    return report.write() ? 1 : 0;
 }
 
-static float matrix_mult_st_cpu(size_t runs, size_t len, const mtype_t *a, const mtype_t *b, mtype_t *out) {
+static float matrix_mult_cpu(MatrixMultBlocked &gemm, size_t runs, size_t len, const mtype_t *a, const mtype_t *b, mtype_t *out) {
     auto start = std::chrono::high_resolution_clock::now();
 
     for (auto run = 0; run < runs; run++) {
-        for (auto i = 0; i < len; i++) {
-            for (auto j = 0; j < len; j++) {
-                auto sum = 0;
-                for (auto k = 0; k < len; k++) {
-                    sum += a[i*len + k] * b[k*len + j];
-                }
-                out[i*len + j] = sum;
-            }
-        }
+        gemm.multiply(len, a, b, out);
     }
 
     auto end = std::chrono::high_resolution_clock::now();
@@ -134,88 +404,174 @@ static float matrix_mult_st_cpu(size_t runs, size_t len, const mtype_t *a, const
     return (float)runtime / runs;
 }
 
-static void _sycl_enqueue(sycl::queue &q, size_t runs, size_t len, sycl::buffer<mtype_t> &a, sycl::buffer<mtype_t> &b, sycl::buffer<mtype_t> &out) {
-    q.submit([&](sycl::handler &cgh) {
-        auto accA   = sycl::accessor{a,   cgh, sycl::read_only};
-        auto accB   = sycl::accessor{b,   cgh, sycl::read_only};
-        auto accOut = sycl::accessor{out, cgh, sycl::read_write, sycl::no_init};
+/* Kernels multiply `rows` rows of A by all of B, into `rows` rows of out. The
+ * matrices are accessors or USM pointers */
+template <typename In, typename Out>
+static void _sycl_kernel_naive(sycl::handler &cgh, size_t rows, size_t len, In accA, In accB, Out accOut) {
+    cgh.parallel_for(sycl::range<2>(rows, len), [=](sycl::id<2> idx) {
+        auto i = idx[0];
+        auto j = idx[1];
+
+        auto sum = 0;
+        for (auto k = 0; k < len; k++) {
+            sum += accA[i*len + k] * accB[k*len + j];
+        }
+        accOut[i*len + j] = sum;
+    });
+}
+
+template <typename In, typename Out>
+static void _sycl_kernel_tiled(sycl::handler &cgh, size_t rows, size_t len, In accA, In accB, Out accOut) {
+    constexpr size_t wg = MAT_TILE / MAT_REG;
+    auto row_groups = (rows + MAT_TILE - 1) / MAT_TILE;
+    auto col_groups = (len + MAT_TILE - 1) / MAT_TILE;
+
+    /* A tile is MAT_TILE rows of MAT_TILE_K, B tile MAT_TILE_K rows of
+     * MAT_TILE */
+    sycl::local_accessor<mtype_t, 1> tileA{sycl::range<1>(MAT_TILE * MAT_TILE_K), cgh};
+    sycl::local_accessor<mtype_t, 1> tileB{sycl::range<1>(MAT_TILE_K * MAT_TILE), cgh};
+
+    cgh.parallel_for(sycl::nd_range<2>(sycl::range<2>(row_groups * wg, col_groups * wg), sycl::range<2>(wg, wg)),
+                     [=](sycl::nd_item<2> it) {
+        auto li = it.get_local_id(0);
+        auto lj = it.get_local_id(1);
+        auto lid = li * wg + lj;
+        auto row0 = it.get_group(0) * MAT_TILE;
+        auto col0 = it.get_group(1) * MAT_TILE;
+
+        /* Work-item outputs are strided by the work-group size, so
+         * neighbouring work-items read neighbouring local memory */
+        mtype_t acc[MAT_REG][MAT_REG];
+        for (size_t r = 0; r < MAT_REG; r++) {
+            for (size_t c = 0; c < MAT_REG; c++) {
+                acc[r][c] = 0;
+            }
+        }
 
-        cgh.parallel_for(sycl::range<2>(len, len), [=](sycl::id<2> idx) {
-            auto i = idx[0];
-            auto j = idx[1];
+        for (size_t k0 = 0; k0 < len; k0 += MAT_TILE_K) {
+            /* Cooperative load, zero-filled past the matrix edges */
+            for (size_t e = lid; e < MAT_TILE * MAT_TILE_K; e += wg * wg) {
+                auto ai = row0 + e / MAT_TILE_K;
+                auto ak = k0 + e % MAT_TILE_K;
+                tileA[e] = ((ai < rows) && (ak < len)) ? accA[ai*len + ak] : 0;
 
-            auto sum = 0;
-            for (auto k = 0; k < len; k++) {
-                sum += accA[i*len + k] * accB[k*len + j];
+                auto bk = k0 + e / MAT_TILE;
+                auto bj = col0 + e % MAT_TILE;
+                tileB[e] = ((bk < len) && (bj < len)) ? accB[bk*len + bj] : 0;
             }
-            accOut[i*len + j] = sum;
-        });
+            sycl::group_barrier(it.get_group());
+
+            for (size_t k = 0; k < MAT_TILE_K; k++) {
+                mtype_t a_reg[MAT_REG];
+                mtype_t b_reg[MAT_REG];
+                for (size_t r = 0; r < MAT_REG; r++) {
+                    a_reg[r] = tileA[(li + r * wg) * MAT_TILE_K + k];
+                    b_reg[r] = tileB[k * MAT_TILE + lj + r * wg];
+                }
+                for (size_t r = 0; r < MAT_REG; r++) {
+                    for (size_t c = 0; c < MAT_REG; c++) {
+                        acc[r][c] += a_reg[r] * b_reg[c];
+                    }
+                }
+            }
+            sycl::group_barrier(it.get_group());
+        }
+
+        for (size_t r = 0; r < MAT_REG; r++) {
+            auto i = row0 + li + r * wg;
+            for (size_t c = 0; c < MAT_REG; c++) {
+                auto j = col0 + lj + c * wg;
+                if ((i < rows) && (j < len)) {
+                    accOut[i*len + j] = acc[r][c];
+                }
+            }
+        }
     });
 }
 
-static float matrix_mult_sycl(sycl::queue &q, size_t runs, size_t len, const mtype_t *a, const mtype_t *b, mtype_t *out) {
-    unsigned long runtime = 0;
+/* The tiled kernel needs a full MAT_TILE / MAT_REG square work-group */
+static bool _sycl_tiled_supported(sycl::queue &q) {
+    constexpr size_t wg = MAT_TILE / MAT_REG;
+    return q.get_device().get_info<sycl::info::device::max_work_group_size>() >= wg * wg;
+}
 
-    try {
-        auto bufA   = sycl::buffer{a,   sycl::range{len*len}};
-        auto bufB   = sycl::buffer{b,   sycl::range{len*len}};
-        auto bufOut = sycl::buffer{out, sycl::range{len*len}};
+template <typename In, typename Out>
+static void _sycl_kernel(sycl::handler &cgh, bool tiled, size_t rows, size_t len, In a, In b, Out out) {
+    if (tiled) {
+        _sycl_kernel_tiled(cgh, rows, len, a, b, out);
+    } else {
+        _sycl_kernel_naive(cgh, rows, len, a, b, out);
+    }
+}
 
-        auto start = std::chrono::high_resolution_clock::now();
+static void _sycl_enqueue(sycl::queue &q, bool tiled, size_t rows, size_t len, sycl::buffer<mtype_t> &a, sycl::buffer<mtype_t> &b, sycl::buffer<mtype_t> &out) {
+    tiled = tiled && _sycl_tiled_supported(q);
 
-        _sycl_enqueue(q, runs, len, bufA, bufB, bufOut);
-        q.wait();
+    q.submit([&](sycl::handler &cgh) {
+        auto accA   = sycl::accessor{a,   cgh, sycl::read_only};
+        auto accB   = sycl::accessor{b,   cgh, sycl::read_only};
+        auto accOut = sycl::accessor{out, cgh, sycl::read_write, sycl::no_init};
 
-        auto end = std::chrono::high_resolution_clock::now();
-        runtime = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+        _sycl_kernel(cgh, tiled, rows, len, accA, accB, accOut);
+    });
+}
 
-        q.throw_asynchronous();
-    } catch (const sycl::exception &e) {
-        std::cerr << "Exception caught: " << e.what() << std::endl;
+/* Nanoseconds per multiplication over `runs` pipelined iterations, transfers
+ * included. A single run is the latency of one multiplication, more runs the
+ * sustained throughput with transfers overlapping the kernels */
+static float matrix_mult_sycl(sycl::queue &q, bool tiled, size_t runs, size_t len, const mtype_t *a, const mtype_t *b, mtype_t *out) {
+    tiled = tiled && _sycl_tiled_supported(q);
+
+    auto bytes = len*len * sizeof(mtype_t);
+    SyclPipeline pipeline(q, {bytes, bytes}, {bytes});
+
+    const void *host_in[] = {a, b};
+    void *host_out[] = {out};
+    auto runtime = pipeline.run(runs, host_in, host_out,
+                                [&](sycl::queue &q, const std::vector<sycl::event> &deps, void *const *in, void *const *res) {
+        return q.submit([&](sycl::handler &cgh) {
+            cgh.depends_on(deps);
+            _sycl_kernel(cgh, tiled, len, len, (const mtype_t *)in[0], (const mtype_t *)in[1], (mtype_t *)res[0]);
+        });
+    });
+    if (runtime < 0) {
         return -1;
     }
 
-    return (float)runtime / runs;
+    return (float)(runtime / runs);
 }
 
 #if SYCL_USE_X2
-static float matrix_mult_sycl_x2(sycl::queue &q1, sycl::queue &q2, size_t runs, size_t len, const mtype_t *a, const mtype_t *b, mtype_t *out) {
-    auto a_copy   = new mtype_t[len*len];
-    auto b_copy   = new mtype_t[len*len];
-    auto out_copy = new mtype_t[len*len];
-    std::memcpy(a_copy,   a,   len*len * sizeof(mtype_t));
-    std::memcpy(b_copy,   b,   len*len * sizeof(mtype_t));
-    std::memcpy(out_copy, out, len*len * sizeof(mtype_t));
-
-    unsigned long runtime = 0;
-
-    try {
-        auto bufA   = sycl::buffer{a,   sycl::range{len*len}};
-        auto bufB   = sycl::buffer{b,   sycl::range{len*len}};
-        auto bufOut = sycl::buffer{out, sycl::range{len*len}};
-
-        auto bufACopy   = sycl::buffer{a_copy,   sycl::range{len*len}};
-        auto bufBCopy   = sycl::buffer{b_copy,   sycl::range{len*len}};
-        auto bufOutCopy = sycl::buffer{out_copy, sycl::range{len*len}};
-
-        auto start = std::chrono::high_resolution_clock::now();
-
-        _sycl_enqueue(q1, runs, len, bufA, bufB, bufOut);
-        _sycl_enqueue(q2, runs, len, bufACopy, bufBCopy, bufOutCopy);
-        q1.wait();
-        q2.wait();
-
-        auto end = std::chrono::high_resolution_clock::now();
-        runtime = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
-
-        q1.throw_asynchronous();
-        q2.throw_asynchronous();
-    } catch (const sycl::exception &e) {
-        std::cout << "Exception caught: " << e.what() << std::endl;
-        return -1;
+static float matrix_mult_sycl_x2(HeteroScheduler &sched, size_t runs, size_t len, const mtype_t *a, const mtype_t *b, mtype_t *out) {
+    /* Each queue multiplies its own band of rows of A into the same rows of
+     * the shared output, all of B is read by every queue */
+    auto work = [&](sycl::queue &q, size_t begin, size_t end) {
+        try {
+            {
+                auto bufA   = sycl::buffer{a + begin*len,   sycl::range{(end - begin)*len}};
+                auto bufB   = sycl::buffer{b,               sycl::range{len*len}};
+                auto bufOut = sycl::buffer{out + begin*len, sycl::range{(end - begin)*len}};
+
+                _sycl_enqueue(q, true, end - begin, len, bufA, bufB, bufOut);
+            }
+            q.throw_asynchronous();
+        } catch (const sycl::exception &e) {
+            std::cerr << "Exception caught: " << e.what() << std::endl;
+            return -1;
+        }
+        return 0;
+    };
+
+    double runtime = 0;
+    for (auto run = 0; run < runs; run++) {
+        auto elapsed = sched.run(len, work);
+        if (elapsed < 0) {
+            return -1;
+        }
+        runtime += elapsed;
     }
 
-    return (float)runtime / (runs * 2);
+    return (float)(runtime / runs);
 }
 #endif /* SYCL_USE_X2 */
 
@@ -1,28 +1,76 @@
+#include <algorithm>
 #include <chrono>
 #include <cmath>
 
 #include <cstring>
+#include <functional>
+#include <string>
 #include <sycl/sycl.hpp>
+#include <vector>
+
+#include "common/bench.hpp"
+#include "common/dispatch.hpp"
+#include "common/hetero.hpp"
+#include "common/pipeline.hpp"
+#include "common/thread_pool.hpp"
+#include "vexpr.hpp"
 
 class scalar_add;
 
 typedef float vtype_t;
 
+/* Operations of the fused benchmarks */
+enum class VecOp {
+    Chain,
+    Dot,
+};
+
+/* STREAM kernels, all writing to a third vector */
+enum class StreamOp {
+    Copy,
+    Scale,
+    Add,
+    Triad,
+};
+
 #define VEC_SZ_MIN 16
 #define VEC_SZ_MAX 1024 * 1024 * 64
 #define VEC_SZ_STEP(sz) ((sz) * 2)
 
+/* Pipelined SYCL runs enqueue REPEAT_COUNT multiplications back to back and
+ * report the sustained time per multiplication, the plain SYCL columns are the
+ * latency of a single one including its transfers */
 #define REPEAT_COUNT 64
 
-#define CPU_MAX_SPLIT 16
-#define GPU_MAX_SPLIT 2048
+/* Harness defaults, each sample is REPEAT_COUNT multiplications */
+#define BENCH_WARMUP 1
+#define BENCH_REPEAT 20
+
+/* Fused benchmarks: the chain out = (a * b + c) * VEC_SCALE and the dot
+ * product sum(a * b), each also run as one pass per operation */
+#define VEC_SCALE 0.5f
+
+/* Multithreaded CPU: vectors are split into blocks of VEC_NUMA_BLOCK elements,
+ * block k going to pool thread k % threads. The buffers are first touched with
+ * the same mapping, so every thread works on pages of its own NUMA node.
+ * Results of at least VEC_NT_MIN_BYTES, too large to be read back from cache,
+ * are written with non-temporal stores */
+#define VEC_NUMA_BLOCK (64 * 1024)
+#define VEC_NT_MIN_BYTES (8 * 1024 * 1024)
+
+/* STREAM-style roofline over VEC_SZ_MAX elements, multithreaded the same way.
+ * The fastest kernel is the peak every column is compared against */
+#define STREAM_SCALE 3.0f
 
 #define SYCL_USE_GPU 1
 #define SYCL_USE_CPU 1
 
-#if SYCL_USE_GPU && SYCL_USE_CPU
-/* If we have both GPU and CPU, we can run both in parallel */
+#if SYCL_USE_CPU
+/* Split runs spread each multiplication over the GPU and CPU in proportion to
+ * their measured throughput, or over the NUMA domains of the CPU when there is
+ * no GPU. Slices are multiples of VEC_SPLIT_GRANULE elements */
 #  define SYCL_USE_X2 1
+#  define VEC_SPLIT_GRANULE 4096
 #else
 #  define SYCL_USE_X2 0
 #endif
@@ -32,74 +80,325 @@ typedef float vtype_t;
 
 static void display_devices();
 static float vector_mult_st_cpu(size_t runs, size_t len, const vtype_t *a, const vtype_t *b, vtype_t *out);
+template <typename F>
+static void vector_parallel(ThreadPool &pool, size_t len, F &&fn);
+static float vector_mult_mt_cpu(ThreadPool &pool, size_t runs, size_t len, const vtype_t *a, const vtype_t *b, vtype_t *out);
+static float vector_stream(ThreadPool &pool, StreamOp op, size_t len, const vtype_t *a, const vtype_t *b, vtype_t *out);
 static float vector_mult_sycl(sycl::queue &q, size_t runs, size_t len,const vtype_t *a, const vtype_t *b, vtype_t *out);
+static float vector_fused_cpu(VecOp op, bool fused, size_t runs, size_t len, const vtype_t *a, const vtype_t *b, const vtype_t *c, vtype_t *out);
+static float vector_fused_sycl(sycl::queue &q, VecOp op, bool fused, size_t runs, size_t len, const vtype_t *a, const vtype_t *b, const vtype_t *c, vtype_t *out);
 #if SYCL_USE_X2
-static float vector_mult_sycl_x2(sycl::queue &q1, sycl::queue &q2, size_t runs, size_t len, const vtype_t *a, const vtype_t *b, vtype_t *out);
+static float vector_mult_sycl_x2(HeteroScheduler &sched, size_t runs, size_t len, const vtype_t *a, const vtype_t *b, vtype_t *out);
 #endif
 
 
 
-int main() {
+int main(int argc, char **argv) {
+    BenchOptions opts;
+    opts.warmup = BENCH_WARMUP;
+    opts.repeat = BENCH_REPEAT;
+    auto args = bench_parse_args(argc, argv, opts);
+    if (args) {
+        return (args < 0) ? 1 : 0;
+    }
+
     display_devices();
 
+    /* Queues are only created for the selected devices, so a machine without
+     * a GPU can still run the CPU columns */
 #if SYCL_USE_GPU
-    auto sycl_gpu = sycl::queue{sycl::gpu_selector_v};
-    std::cerr << "Chosen SYCL GPU device: "
-              << sycl_gpu.get_device().get_info<sycl::info::device::name>()
-              << std::endl << std::endl;
+    auto use_gpu = bench_device_selected(opts, "gpu");
+    sycl::queue sycl_gpu;
+    if (use_gpu) {
+        sycl_gpu = sycl::queue{sycl::gpu_selector_v};
+        std::cerr << "Chosen SYCL GPU device: "
+                  << sycl_gpu.get_device().get_info<sycl::info::device::name>()
+                  << std::endl << std::endl;
+    }
 #endif
 
 #if SYCL_USE_CPU
-    auto sycl_cpu = sycl::queue{sycl::cpu_selector_v};
-
-    std::cerr << "Chosen SYCL CPU device: "
-              << sycl_cpu.get_device().get_info<sycl::info::device::name>()
-              << std::endl << std::endl;
+    auto use_cpu = bench_device_selected(opts, "cpu");
+    sycl::queue sycl_cpu;
+    if (use_cpu) {
+        sycl_cpu = sycl::queue{sycl::cpu_selector_v};
+        std::cerr << "Chosen SYCL CPU device: "
+                  << sycl_cpu.get_device().get_info<sycl::info::device::name>()
+                  << std::endl << std::endl;
+    }
 #endif
 
-    /* Setup input and output buffers */
+    ThreadPool pool(-1);
+
+    /* Setup input and output buffers, first touched by the threads that use
+     * them in the multithreaded runs */
     auto vec_a   = new vtype_t[VEC_SZ_MAX];
     auto vec_b   = new vtype_t[VEC_SZ_MAX];
+    auto vec_c   = new vtype_t[VEC_SZ_MAX];
     auto vec_out = new vtype_t[VEC_SZ_MAX];
+    {
+        ThreadPool::CallerPin pin(pool);
+        vector_parallel(pool, VEC_SZ_MAX, [&](size_t begin, size_t end) {
+            std::fill(vec_a + begin,   vec_a + end,   (vtype_t)1);
+            std::fill(vec_b + begin,   vec_b + end,   (vtype_t)2);
+            std::fill(vec_c + begin,   vec_c + end,   (vtype_t)3);
+            std::fill(vec_out + begin, vec_out + end, (vtype_t)0);
+        });
+    }
 
-    std::cout << "# units for runtime in nanoseconds per iteration" << std::endl;
-    std::cout << "vector size, single threaded CPU"
+    /* One column per algorithm and device. `bytes` is the least memory
+     * traffic per element the operation needs, the same for its fused and
+     * split versions, so their GB/s compare directly */
+    struct Column {
+        std::string algo;
+        std::string device;
+        std::string title;
+        double bytes;
+        std::function<float(size_t)> run;
+    };
+    std::vector<Column> columns;
+    const double mult_bytes = 3.0 * sizeof(vtype_t);
+
+    /* Fused benchmarks, per operation its name, traffic and title */
+    struct FusedOp {
+        VecOp op;
+        std::string name;
+        double bytes;
+        std::string title;
+    };
+    const std::vector<FusedOp> fused_ops = {
+        {VecOp::Chain, "chain", 4.0 * sizeof(vtype_t), "(a*b + c) * s"},
+        {VecOp::Dot,   "dot",   2.0 * sizeof(vtype_t), "dot"},
+    };
+
+    if (bench_algo_selected(opts, "st_cpu")) {
+        columns.push_back({"st_cpu", "host", "single threaded CPU", mult_bytes, [&](size_t len) {
+            return vector_mult_st_cpu(REPEAT_COUNT, len, vec_a, vec_b, vec_out);
+        }});
+    }
+    if (bench_algo_selected(opts, "mt_cpu")) {
+        columns.push_back({"mt_cpu", "host", "multithreaded CPU", mult_bytes, [&](size_t len) {
+            return vector_mult_mt_cpu(pool, REPEAT_COUNT, len, vec_a, vec_b, vec_out);
+        }});
+    }
 #if SYCL_USE_GPU
-              << ", sycl GPU"
+    if (use_gpu && bench_algo_selected(opts, "sycl")) {
+        columns.push_back({"sycl", "gpu", "sycl GPU", mult_bytes, [&](size_t len) {
+            return vector_mult_sycl(sycl_gpu, 1, len, vec_a, vec_b, vec_out);
+        }});
+    }
+    if (use_gpu && bench_algo_selected(opts, "sycl_pipe")) {
+        columns.push_back({"sycl_pipe", "gpu", "sycl GPU pipelined", mult_bytes, [&](size_t len) {
+            return vector_mult_sycl(sycl_gpu, REPEAT_COUNT, len, vec_a, vec_b, vec_out);
+        }});
+    }
 #endif
 #if SYCL_USE_CPU
-              << ", sycl CPU"
+    if (use_cpu && bench_algo_selected(opts, "sycl")) {
+        columns.push_back({"sycl", "cpu", "sycl CPU", mult_bytes, [&](size_t len) {
+            return vector_mult_sycl(sycl_cpu, 1, len, vec_a, vec_b, vec_out);
+        }});
+    }
+    if (use_cpu && bench_algo_selected(opts, "sycl_pipe")) {
+        columns.push_back({"sycl_pipe", "cpu", "sycl CPU pipelined", mult_bytes, [&](size_t len) {
+            return vector_mult_sycl(sycl_cpu, REPEAT_COUNT, len, vec_a, vec_b, vec_out);
+        }});
+    }
 #endif
 #if SYCL_USE_X2
-              << ", sycl GPU+CPU"
+    HeteroScheduler hetero(VEC_SPLIT_GRANULE);
+    std::string hetero_device = "cpu_numa";
+#if SYCL_USE_GPU
+    if (use_gpu && use_cpu) {
+        hetero.add(sycl_gpu, "gpu");
+        hetero.add(sycl_cpu, "cpu");
+        hetero_device = "gpu+cpu";
+    }
 #endif
-              << std::endl;
+    if (use_cpu && (hetero.size() == 0)) {
+        auto cpu_queues = hetero_cpu_queues(sycl_cpu.get_device());
+        for (auto i = 0; i < cpu_queues.size(); i++) {
+            hetero.add(cpu_queues[i], "cpu" + std::to_string(i));
+        }
+    }
+    if ((hetero.size() > 1) && bench_algo_selected(opts, "sycl_x2")) {
+        columns.push_back({"sycl_x2", hetero_device, "sycl split " + hetero_device, mult_bytes, [&](size_t len) {
+            return vector_mult_sycl_x2(hetero, REPEAT_COUNT, len, vec_a, vec_b, vec_out);
+        }});
+    }
+#endif
+    for (auto &f : fused_ops) {
+        for (auto fused : {true, false}) {
+            auto algo = f.name + (fused ? "" : "_split");
+            auto title = (fused ? "fused " : "split ") + f.title;
+            if (bench_algo_selected(opts, algo)) {
+                columns.push_back({algo, "host", title + " CPU", f.bytes, [&, fused](size_t len) {
+                    return vector_fused_cpu(f.op, fused, REPEAT_COUNT, len, vec_a, vec_b, vec_c, vec_out);
+                }});
+            }
+#if SYCL_USE_GPU
+            if (use_gpu && bench_algo_selected(opts, algo)) {
+                columns.push_back({algo, "gpu", title + " sycl GPU", f.bytes, [&, fused](size_t len) {
+                    return vector_fused_sycl(sycl_gpu, f.op, fused, REPEAT_COUNT, len, vec_a, vec_b, vec_c, vec_out);
+                }});
+            }
+#endif
+#if SYCL_USE_CPU
+            if (use_cpu && bench_algo_selected(opts, algo)) {
+                columns.push_back({algo, "cpu", title + " sycl CPU", f.bytes, [&, fused](size_t len) {
+                    return vector_fused_sycl(sycl_cpu, f.op, fused, REPEAT_COUNT, len, vec_a, vec_b, vec_c, vec_out);
+                }});
+            }
+#endif
+        }
+    }
 
+    std::vector<size_t> default_sizes;
     for (auto len = VEC_SZ_MIN; len <= VEC_SZ_MAX; len = VEC_SZ_STEP(len)) {
-        std::cout << len;
+        default_sizes.push_back(len);
+    }
+
+    BenchReport report("vector-demo", opts);
 
-        auto rt_st_cpu   = vector_mult_st_cpu(REPEAT_COUNT, len, vec_a, vec_b, vec_out);
-        std::cout << ", " << rt_st_cpu;
+    /* Dispatch columns multiply small vectors inline on the host and larger
+     * ones pipelined on the device, from the crossover calibrated here */
+    SyclDispatch dispatch;
+    auto add_dispatch = [&](sycl::queue &q, const std::string &device, const std::string &title) {
+        auto dev = dispatch.add_device(q, device);
+        report.add("launch", device, 0, dispatch.launch_overhead(dev), 0, 0);
+        if (!bench_algo_selected(opts, "sycl_auto")) {
+            return;
+        }
+
+        auto host = [&](size_t len) {
+            return (double)vector_mult_st_cpu(REPEAT_COUNT, len, vec_a, vec_b, vec_out);
+        };
+        auto device_path = [&](size_t len) {
+            return (double)vector_mult_sycl(q, REPEAT_COUNT, len, vec_a, vec_b, vec_out);
+        };
+        auto handle = dispatch.calibrate("mult", dev, default_sizes, host, device_path);
+        columns.push_back({"sycl_auto", device, title, mult_bytes, [&, handle, host, device_path](size_t len) {
+            return (float)(dispatch.on_device(handle, len) ? device_path(len) : host(len));
+        }});
+    };
 #if SYCL_USE_GPU
-        auto rt_sycl_gpu = vector_mult_sycl(sycl_gpu, REPEAT_COUNT, len, vec_a, vec_b, vec_out);
-        std::cout << ", " << rt_sycl_gpu;
+    if (use_gpu) {
+        add_dispatch(sycl_gpu, "gpu", "dispatch GPU");
+    }
 #endif
 #if SYCL_USE_CPU
-        auto rt_sycl_cpu = vector_mult_sycl(sycl_cpu, REPEAT_COUNT, len, vec_a, vec_b, vec_out);
-        std::cout << ", " << rt_sycl_cpu;
-#endif
-#if SYCL_USE_X2
-        auto rt_sycl_x2 = vector_mult_sycl_x2(sycl_gpu, sycl_cpu, REPEAT_COUNT, len, vec_a, vec_b, vec_out);
-        std::cout << ", " << rt_sycl_x2;
+    if (use_cpu) {
+        add_dispatch(sycl_cpu, "cpu", "dispatch CPU");
+    }
 #endif
 
+    struct StreamKernel {
+        StreamOp op;
+        std::string name;
+        double bytes;
+        double flops;
+    };
+    const std::vector<StreamKernel> stream_kernels = {
+        {StreamOp::Copy,  "copy",  2.0 * sizeof(vtype_t), 0},
+        {StreamOp::Scale, "scale", 2.0 * sizeof(vtype_t), 1},
+        {StreamOp::Add,   "add",   3.0 * sizeof(vtype_t), 1},
+        {StreamOp::Triad, "triad", 3.0 * sizeof(vtype_t), 2},
+    };
+
+    std::cout << "# STREAM roofline over " << VEC_SZ_MAX << " elements on " << pool.concurrency()
+              << " threads, GB/s at the median" << std::endl;
+    std::cout << "kernel, GB/s" << std::endl;
+    double peak = 0;
+    std::string peak_name;
+    for (auto &k : stream_kernels) {
+        /* Pinned once for all of a kernel's samples */
+        ThreadPool::CallerPin pin(pool);
+        auto stats = bench_measure(opts, [&]() -> double {
+            return vector_stream(pool, k.op, VEC_SZ_MAX, vec_a, vec_b, vec_out);
+        });
+        report.add("stream_" + k.name, "host", VEC_SZ_MAX, stats, k.flops * VEC_SZ_MAX, k.bytes * VEC_SZ_MAX);
+
+        auto rate = stats.ok ? k.bytes * VEC_SZ_MAX / stats.median : 0;
+        std::cout << k.name << ", " << rate << std::endl;
+        if (rate > peak) {
+            peak = rate;
+            peak_name = k.name;
+        }
+    }
+    std::cout << std::endl;
+
+    std::cout << "# units for runtime in nanoseconds per iteration, median of "
+              << opts.repeat << " samples" << (opts.cold ? ", cold cache" : "") << std::endl;
+    std::cout << "vector size";
+    for (auto &col : columns) {
+        std::cout << ", " << col.title;
+    }
+    std::cout << std::endl;
+
+    /* Bandwidth of each row, printed as a second table */
+    std::vector<std::pair<size_t, std::vector<float>>> rates;
+
+    for (auto len : bench_sizes(opts, default_sizes)) {
+        if (len > VEC_SZ_MAX) {
+            continue;
+        }
+        std::cout << len;
+        rates.push_back({len, {}});
+
+        for (auto &col : columns) {
+            auto stats = bench_measure(opts, [&]() -> double { return col.run(len); });
+            std::cout << ", " << (stats.ok ? stats.median : -1);
+            report.add(col.algo, col.device, len, stats, (double)len, col.bytes * len);
+            rates.back().second.push_back(stats.ok ? (float)(col.bytes * len / stats.median) : 0);
+        }
+
         std::cout << std::endl;
 
         /* Without this, the compiler may optimize out our function call */
         MARK_USED(vec_out);
     }
 
-    return 0;
+    std::cout << std::endl << "# effective GB/s at the median, from the least traffic each operation needs" << std::endl;
+    std::cout << "vector size";
+    for (auto &col : columns) {
+        std::cout << ", " << col.title;
+    }
+    std::cout << std::endl;
+    for (auto &row : rates) {
+        std::cout << row.first;
+        for (auto rate : row.second) {
+            std::cout << ", " << rate;
+        }
+        std::cout << std::endl;
+    }
+
+    if (peak > 0) {
+        std::cout << std::endl << "# percent of the STREAM peak, " << peak_name << " at " << peak
+                  << " GB/s, sizes that fit in cache can exceed it" << std::endl;
+        std::cout << "vector size";
+        for (auto &col : columns) {
+            std::cout << ", " << col.title;
+        }
+        std::cout << std::endl;
+        for (auto &row : rates) {
+            std::cout << row.first;
+            for (auto rate : row.second) {
+                std::cout << ", " << 100.0 * rate / peak;
+            }
+            std::cout << std::endl;
+        }
+    }
+
+#if SYCL_USE_X2
+    if (hetero.size() > 1) {
+        std::cout << std::endl << "# split shares after the last run: " << hetero.shares() << std::endl;
+    }
+#endif
+
+    std::cout << std::endl;
+    dispatch.print(std::cout);
+
+    return report.write() ? 1 : 0;
 }
 
 static float vector_mult_st_cpu(size_t runs, size_t len, const vtype_t *a, const vtype_t *b, vtype_t *out) {
@@ -117,81 +416,258 @@ static float vector_mult_st_cpu(size_t runs, size_t len, const vtype_t *a, const
     return (float)runtime / runs;
 }
 
-static void _sycl_enqueue(sycl::queue &q, size_t runs, size_t len, sycl::buffer<vtype_t> &a, sycl::buffer<vtype_t> &b, sycl::buffer<vtype_t> &out) {
+/* Run fn(begin, end) over the blocks of [0, len) in parallel, block k on pool
+ * thread k % threads whatever `len` is, so a block is always handled by the
+ * thread, and CPU, that first touched it. Thread 0 is this one, callers hold a
+ * ThreadPool::CallerPin so it stays on the same CPU */
+template <typename F>
+static void vector_parallel(ThreadPool &pool, size_t len, F &&fn) {
+    auto threads = pool.concurrency();
+    pool.parallel_for_each_thread([&](size_t t) {
+        for (size_t begin = t * VEC_NUMA_BLOCK; begin < len; begin += threads * VEC_NUMA_BLOCK) {
+            fn(begin, std::min<size_t>(len, begin + VEC_NUMA_BLOCK));
+        }
+    });
+}
+
+static float vector_mult_mt_cpu(ThreadPool &pool, size_t runs, size_t len, const vtype_t *a, const vtype_t *b, vtype_t *out) {
+    auto stream = len * sizeof(vtype_t) >= VEC_NT_MIN_BYTES;
+
+    /* Pinned once for all the runs, outside the timed interval */
+    ThreadPool::CallerPin pin(pool);
+    auto start = std::chrono::high_resolution_clock::now();
+
+    for (auto run = 0; run < runs; run++) {
+        vector_parallel(pool, len, [&](size_t begin, size_t end) {
+            auto e = vx_vec(a + begin) * vx_vec(b + begin);
+            if (stream) {
+                vx_assign_stream(out + begin, end - begin, e);
+            } else {
+                vx_assign(out + begin, end - begin, e);
+            }
+        });
+    }
+
+    auto end = std::chrono::high_resolution_clock::now();
+    unsigned long runtime = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+
+    return (float)runtime / runs;
+}
+
+/* One pass of a STREAM kernel, `out` = a, s * b, a + b or a + s * b. The
+ * caller holds a ThreadPool::CallerPin across the samples */
+static float vector_stream(ThreadPool &pool, StreamOp op, size_t len, const vtype_t *a, const vtype_t *b, vtype_t *out) {
+    auto start = std::chrono::high_resolution_clock::now();
+
+    vector_parallel(pool, len, [&](size_t begin, size_t end) {
+        auto A = vx_vec(a + begin);
+        auto B = vx_vec(b + begin);
+        switch (op) {
+        case StreamOp::Copy:
+            vx_assign_stream(out + begin, end - begin, A);
+            break;
+        case StreamOp::Scale:
+            vx_assign_stream(out + begin, end - begin, B * STREAM_SCALE);
+            break;
+        case StreamOp::Add:
+            vx_assign_stream(out + begin, end - begin, A + B);
+            break;
+        case StreamOp::Triad:
+            vx_assign_stream(out + begin, end - begin, A + B * STREAM_SCALE);
+            break;
+        }
+    });
+
+    auto end = std::chrono::high_resolution_clock::now();
+    unsigned long runtime = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+
+    return (float)runtime;
+}
+
+/* The vectors are accessors or USM pointers */
+template <typename In, typename Out>
+static void _sycl_kernel(sycl::handler &cgh, size_t len, In accA, In accB, Out accOut) {
+    cgh.parallel_for(sycl::range<1>(len), [=](sycl::id<1> idx) {
+        auto i = idx[0];
+        accOut[i] = accA[i] * accB[i];
+    });
+}
+
+static void _sycl_enqueue(sycl::queue &q, size_t len, sycl::buffer<vtype_t> &a, sycl::buffer<vtype_t> &b, sycl::buffer<vtype_t> &out) {
     q.submit([&](sycl::handler &cgh) {
         auto accA   = sycl::accessor{a,   cgh, sycl::read_only};
         auto accB   = sycl::accessor{b,   cgh, sycl::read_only};
         auto accOut = sycl::accessor{out, cgh, sycl::write_only, sycl::no_init};
 
-        cgh.parallel_for(sycl::range<1>(len), [=](sycl::id<1> idx) {
-            accOut[idx] = accA[idx] * accB[idx];
-        });
+        _sycl_kernel(cgh, len, accA, accB, accOut);
     });
 }
 
+/* Nanoseconds per multiplication over `runs` pipelined iterations, transfers
+ * included. A single run is the latency of one multiplication, more runs the
+ * sustained throughput with transfers overlapping the kernels */
 static float vector_mult_sycl(sycl::queue &q, size_t runs, size_t len, const vtype_t *a, const vtype_t *b, vtype_t *out) {
-    unsigned long runtime = 0;
+    auto bytes = len * sizeof(vtype_t);
+    SyclPipeline pipeline(q, {bytes, bytes}, {bytes});
+
+    const void *host_in[] = {a, b};
+    void *host_out[] = {out};
+    auto runtime = pipeline.run(runs, host_in, host_out,
+                                [&](sycl::queue &q, const std::vector<sycl::event> &deps, void *const *in, void *const *res) {
+        return q.submit([&](sycl::handler &cgh) {
+            cgh.depends_on(deps);
+            _sycl_kernel(cgh, len, (const vtype_t *)in[0], (const vtype_t *)in[1], (vtype_t *)res[0]);
+        });
+    });
+    if (runtime < 0) {
+        return -1;
+    }
 
-    try {
-        auto bufA   = sycl::buffer{a,   sycl::range{len}};
-        auto bufB   = sycl::buffer{b,   sycl::range{len}};
-        auto bufOut = sycl::buffer{out, sycl::range{len}};
+    return (float)(runtime / runs);
+}
 
-        auto start = std::chrono::high_resolution_clock::now();
+/* Runs of the chain into `out`, or of the dot product into out[0]. Split runs
+ * compute one operation per pass through `out` */
+static float vector_fused_cpu(VecOp op, bool fused, size_t runs, size_t len, const vtype_t *a, const vtype_t *b, const vtype_t *c, vtype_t *out) {
+    auto A = vx_vec(a);
+    auto B = vx_vec(b);
+    auto C = vx_vec(c);
+    auto T = vx_vec((const vtype_t *)out);
 
-        _sycl_enqueue(q, runs, len, bufA, bufB, bufOut);
-        q.wait();
+    auto start = std::chrono::high_resolution_clock::now();
 
-        auto end = std::chrono::high_resolution_clock::now();
-        runtime = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+    vtype_t sum = 0;
+    for (auto run = 0; run < runs; run++) {
+        if (op == VecOp::Chain) {
+            if (fused) {
+                vx_assign(out, len, (A * B + C) * VEC_SCALE);
+            } else {
+                vx_assign(out, len, A * B);
+                vx_assign(out, len, T + C);
+                vx_assign(out, len, T * VEC_SCALE);
+            }
+        } else {
+            if (fused) {
+                sum += vx_sum(len, A * B);
+            } else {
+                vx_assign(out, len, A * B);
+                sum += vx_sum(len, T);
+            }
+        }
+    }
 
-        q.throw_asynchronous();
-    } catch (const sycl::exception &e) {
-        std::cerr << "Exception caught: " << e.what() << std::endl;
-        return -1;
+    auto end = std::chrono::high_resolution_clock::now();
+    unsigned long runtime = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+
+    if (op == VecOp::Dot) {
+        out[0] = sum / runs;
     }
 
     return (float)runtime / runs;
 }
 
-#if SYCL_USE_X2
-static float vector_mult_sycl_x2(sycl::queue &q1, sycl::queue &q2, size_t runs, size_t len, const vtype_t *a, const vtype_t *b, vtype_t *out) {
-    auto a_copy   = new vtype_t[len];
-    auto b_copy   = new vtype_t[len];
-    auto out_copy = new vtype_t[len];
-    std::memcpy(a_copy,   a,   len * sizeof(vtype_t));
-    std::memcpy(b_copy,   b,   len * sizeof(vtype_t));
-    std::memcpy(out_copy, out, len * sizeof(vtype_t));
+/* As vector_fused_cpu(), with the inputs resident in device memory so only
+ * the kernels are timed */
+static float vector_fused_sycl(sycl::queue &q, VecOp op, bool fused, size_t runs, size_t len, const vtype_t *a, const vtype_t *b, const vtype_t *c, vtype_t *out) {
+    /* a, b, c, out and the sum */
+    vtype_t *dev[5] = {};
+    auto ok = true;
+    for (auto i = 0; i < 5; i++) {
+        dev[i] = sycl::malloc_device<vtype_t>((i < 4) ? len : 1, q);
+        ok = ok && dev[i];
+    }
 
     unsigned long runtime = 0;
 
     try {
-        auto bufA   = sycl::buffer{a,   sycl::range{len}};
-        auto bufB   = sycl::buffer{b,   sycl::range{len}};
-        auto bufOut = sycl::buffer{out, sycl::range{len}};
+        if (ok) {
+            auto bytes = len * sizeof(vtype_t);
+            sycl::event::wait({q.memcpy(dev[0], a, bytes), q.memcpy(dev[1], b, bytes), q.memcpy(dev[2], c, bytes)});
+
+            auto A = vx_vec((const vtype_t *)dev[0]);
+            auto B = vx_vec((const vtype_t *)dev[1]);
+            auto C = vx_vec((const vtype_t *)dev[2]);
+            auto T = vx_vec((const vtype_t *)dev[3]);
+
+            auto start = std::chrono::high_resolution_clock::now();
+
+            /* Each run overwrites the previous one's results */
+            std::vector<sycl::event> deps;
+            for (auto run = 0; run < runs; run++) {
+                if (op == VecOp::Chain) {
+                    if (fused) {
+                        deps = {vx_assign(q, dev[3], len, (A * B + C) * VEC_SCALE, deps)};
+                    } else {
+                        deps = {vx_assign(q, dev[3], len, A * B, deps)};
+                        deps = {vx_assign(q, dev[3], len, T + C, deps)};
+                        deps = {vx_assign(q, dev[3], len, T * VEC_SCALE, deps)};
+                    }
+                } else {
+                    if (fused) {
+                        deps = {vx_sum(q, dev[4], len, A * B, deps)};
+                    } else {
+                        deps = {vx_assign(q, dev[3], len, A * B, deps)};
+                        deps = {vx_sum(q, dev[4], len, T, deps)};
+                    }
+                }
+            }
+            sycl::event::wait(deps);
+
+            auto end = std::chrono::high_resolution_clock::now();
+            runtime = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+
+            if (op == VecOp::Chain) {
+                q.memcpy(out, dev[3], bytes).wait();
+            } else {
+                q.memcpy(out, dev[4], sizeof(vtype_t)).wait();
+            }
+        }
 
-        auto bufACopy   = sycl::buffer{a_copy,   sycl::range{len}};
-        auto bufBCopy   = sycl::buffer{b_copy,   sycl::range{len}};
-        auto bufOutCopy = sycl::buffer{out_copy, sycl::range{len}};
+        q.throw_asynchronous();
+    } catch (const sycl::exception &e) {
+        std::cerr << "Exception caught: " << e.what() << std::endl;
+        ok = false;
+    }
 
-        auto start = std::chrono::high_resolution_clock::now();
+    for (auto ptr : dev) {
+        if (ptr) {
+            sycl::free(ptr, q);
+        }
+    }
 
-        _sycl_enqueue(q1, runs, len, bufA, bufB, bufOut);
-        _sycl_enqueue(q2, runs, len, bufACopy, bufBCopy, bufOutCopy);
-        q1.wait();
-        q2.wait();
+    return ok ? (float)runtime / runs : -1;
+}
 
-        auto end = std::chrono::high_resolution_clock::now();
-        runtime = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+#if SYCL_USE_X2
+static float vector_mult_sycl_x2(HeteroScheduler &sched, size_t runs, size_t len, const vtype_t *a, const vtype_t *b, vtype_t *out) {
+    /* Each queue handles its own slice of the shared vectors */
+    auto work = [&](sycl::queue &q, size_t begin, size_t end) {
+        try {
+            {
+                auto bufA   = sycl::buffer{a + begin,   sycl::range{end - begin}};
+                auto bufB   = sycl::buffer{b + begin,   sycl::range{end - begin}};
+                auto bufOut = sycl::buffer{out + begin, sycl::range{end - begin}};
+
+                _sycl_enqueue(q, end - begin, bufA, bufB, bufOut);
+            }
+            q.throw_asynchronous();
+        } catch (const sycl::exception &e) {
+            std::cerr << "Exception caught: " << e.what() << std::endl;
+            return -1;
+        }
+        return 0;
+    };
 
-        q1.throw_asynchronous();
-        q2.throw_asynchronous();
-    } catch (const sycl::exception &e) {
-        std::cout << "Exception caught: " << e.what() << std::endl;
-        return -1;
+    double runtime = 0;
+    for (auto run = 0; run < runs; run++) {
+        auto elapsed = sched.run(len, work);
+        if (elapsed < 0) {
+            return -1;
+        }
+        runtime += elapsed;
     }
 
-    return (float)runtime / (runs * 2);
+    return (float)(runtime / runs);
 }
 #endif /* SYCL_USE_X2 */
 
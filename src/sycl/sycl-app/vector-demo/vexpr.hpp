@@ -0,0 +1,393 @@
+#ifndef VEXPR_HPP
+#define VEXPR_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <sycl/sycl.hpp>
+#include <type_traits>
+#include <vector>
+
+/*
+ * Fused element-wise expressions
+ *
+ * Vectors wrapped with vx_vec() combine with each other and with scalars
+ * through + - * into an expression tree instead of being computed, e.g.
+ *
+ *     vx_assign(out, len, (vx_vec(a) * vx_vec(b) + vx_vec(c)) * scale);
+ *     auto dot = vx_sum(len, vx_vec(a) * vx_vec(b));
+ *
+ * The whole tree is evaluated in one pass, each input is read once and only
+ * the result is written, where computing it one operation at a time would
+ * write and read back an intermediate vector per operation.
+ *
+ * Nodes are small trivially copyable structs, so the same tree is evaluated
+ * one element at a time inside a SYCL kernel (from USM pointers), or a vector
+ * register at a time on the host. Host evaluation is written once with
+ * GCC/Clang vector extensions and compiled per ISA through target attributes,
+ * the ISA is chosen at runtime.
+ */
+
+#if (defined(__x86_64__) || defined(__i386__)) && !defined(__SYCL_DEVICE_ONLY__)
+#  define VX_X86 1
+#  include <immintrin.h>
+#else
+#  define VX_X86 0
+#endif
+
+/* Independent partial sums per reduction, to hide the add latency */
+#define VX_SUM_ACCUMULATORS 4
+
+#define VX_INLINE inline __attribute__((always_inline))
+
+/* GCC/Clang vector of `bytes` bytes of T */
+template <typename T, size_t bytes>
+struct VxSimd {
+    typedef T type __attribute__((vector_size(bytes)));
+};
+
+/*
+ * Expression nodes
+ *
+ * Each node has the element type `value_t`, the number of vectors it reads
+ * per element `streams`, element access for kernels and a `load` of
+ * sizeof(V) / sizeof(value_t) consecutive elements for the host, where V is
+ * a vector type or value_t itself. Vectors are only passed by reference so
+ * the ABI does not depend on the caller's ISA.
+ */
+
+template <typename T>
+struct VxVec {
+    typedef T value_t;
+    static constexpr size_t streams = 1;
+
+    const T *ptr;
+
+    VX_INLINE T operator[](size_t i) const { return this->ptr[i]; }
+
+    template <typename V>
+    VX_INLINE void load(size_t i, V &v) const {
+        std::memcpy(&v, this->ptr + i, sizeof(V));
+    }
+};
+
+template <typename T>
+struct VxScalar {
+    typedef T value_t;
+    static constexpr size_t streams = 0;
+
+    T value;
+
+    VX_INLINE T operator[](size_t i) const { return this->value; }
+
+    template <typename V>
+    VX_INLINE void load(size_t i, V &v) const {
+        v = V{} + this->value;
+    }
+};
+
+/* Operations update their left operand */
+struct VxAdd {
+    template <typename V>
+    static VX_INLINE void apply(V &l, const V &r) { l = l + r; }
+};
+
+struct VxSub {
+    template <typename V>
+    static VX_INLINE void apply(V &l, const V &r) { l = l - r; }
+};
+
+struct VxMul {
+    template <typename V>
+    static VX_INLINE void apply(V &l, const V &r) { l = l * r; }
+};
+
+template <typename Op, typename L, typename R>
+struct VxBinary {
+    static_assert(std::is_same<typename L::value_t, typename R::value_t>::value,
+                  "operands of an expression must have the same element type");
+
+    typedef typename L::value_t value_t;
+    static constexpr size_t streams = L::streams + R::streams;
+
+    L l;
+    R r;
+
+    VX_INLINE value_t operator[](size_t i) const {
+        value_t v = this->l[i];
+        Op::apply(v, this->r[i]);
+        return v;
+    }
+
+    template <typename V>
+    VX_INLINE void load(size_t i, V &v) const {
+        V rv;
+        this->l.load(i, v);
+        this->r.load(i, rv);
+        Op::apply(v, rv);
+    }
+};
+
+template <typename E> struct vx_is_expr : std::false_type {};
+template <typename T> struct vx_is_expr<VxVec<T>> : std::true_type {};
+template <typename T> struct vx_is_expr<VxScalar<T>> : std::true_type {};
+template <typename Op, typename L, typename R> struct vx_is_expr<VxBinary<Op, L, R>> : std::true_type {};
+
+template <typename T>
+VxVec<T> vx_vec(const T *ptr) { return {ptr}; }
+
+template <typename T>
+VxScalar<T> vx_scalar(T value) { return {value}; }
+
+/* Expression with expression, expression with a scalar of its element type,
+ * and the reverse */
+#define VX_OPERATOR(op, Op) \
+    template <typename L, typename R, \
+              typename = std::enable_if_t<vx_is_expr<L>::value && vx_is_expr<R>::value>> \
+    VxBinary<Op, L, R> operator op(const L &l, const R &r) { return {l, r}; } \
+    template <typename L, typename = std::enable_if_t<vx_is_expr<L>::value>> \
+    VxBinary<Op, L, VxScalar<typename L::value_t>> operator op(const L &l, typename L::value_t r) { return {l, {r}}; } \
+    template <typename R, typename = std::enable_if_t<vx_is_expr<R>::value>> \
+    VxBinary<Op, VxScalar<typename R::value_t>, R> operator op(typename R::value_t l, const R &r) { return {{l}, r}; }
+
+VX_OPERATOR(+, VxAdd)
+VX_OPERATOR(-, VxSub)
+VX_OPERATOR(*, VxMul)
+
+#undef VX_OPERATOR
+
+/*
+ * Host evaluation
+ */
+
+/* Instruction sets usable for host evaluation */
+enum class VxIsa {
+    Scalar,
+    SSE,
+    AVX2,
+    AVX512,
+};
+
+/* Best instruction set the running CPU supports */
+inline VxIsa vx_isa() {
+#if VX_X86
+    static const VxIsa isa = __builtin_cpu_supports("avx512f") ? VxIsa::AVX512
+                           : __builtin_cpu_supports("avx2")    ? VxIsa::AVX2
+                           : __builtin_cpu_supports("sse2")    ? VxIsa::SSE
+                           : VxIsa::Scalar;
+    return isa;
+#else
+    return VxIsa::Scalar;
+#endif
+}
+
+/* V is a vector of W = sizeof(V) / sizeof(value_t) lanes, or value_t itself.
+ * The tail past the last full vector is done one element at a time */
+template <typename V, typename E>
+VX_INLINE void _vx_assign_lanes(typename E::value_t *out, size_t len, const E &e) {
+    constexpr size_t W = sizeof(V) / sizeof(typename E::value_t);
+
+    size_t i = 0;
+    for (; i + W <= len; i += W) {
+        V v;
+        e.load(i, v);
+        std::memcpy(out + i, &v, sizeof(V));
+    }
+    for (; i < len; i++) {
+        out[i] = e[i];
+    }
+}
+
+template <typename V, typename E>
+VX_INLINE typename E::value_t _vx_sum_lanes(size_t len, const E &e) {
+    typedef typename E::value_t T;
+    constexpr size_t W = sizeof(V) / sizeof(T);
+    constexpr size_t step = W * VX_SUM_ACCUMULATORS;
+
+    V acc[VX_SUM_ACCUMULATORS];
+    for (size_t k = 0; k < VX_SUM_ACCUMULATORS; k++) {
+        acc[k] = V{} + 0;
+    }
+
+    size_t i = 0;
+    V v;
+    for (; i + step <= len; i += step) {
+        for (size_t k = 0; k < VX_SUM_ACCUMULATORS; k++) {
+            e.load(i + k * W, v);
+            acc[k] += v;
+        }
+    }
+    for (; i + W <= len; i += W) {
+        e.load(i, v);
+        acc[0] += v;
+    }
+    for (size_t k = 1; k < VX_SUM_ACCUMULATORS; k++) {
+        acc[0] += acc[k];
+    }
+
+    T lanes[W];
+    std::memcpy(lanes, &acc[0], sizeof(V));
+    T sum = 0;
+    for (size_t k = 0; k < W; k++) {
+        sum += lanes[k];
+    }
+    for (; i < len; i++) {
+        sum += e[i];
+    }
+    return sum;
+}
+
+template <typename E>
+void _vx_assign_scalar(typename E::value_t *out, size_t len, const E &e) {
+    _vx_assign_lanes<typename E::value_t>(out, len, e);
+}
+
+template <typename E>
+typename E::value_t _vx_sum_scalar(size_t len, const E &e) {
+    return _vx_sum_lanes<typename E::value_t>(len, e);
+}
+
+#if VX_X86
+template <typename E>
+__attribute__((target("sse2")))
+void _vx_assign_sse(typename E::value_t *out, size_t len, const E &e) {
+    _vx_assign_lanes<typename VxSimd<typename E::value_t, 16>::type>(out, len, e);
+}
+
+template <typename E>
+__attribute__((target("avx2")))
+void _vx_assign_avx2(typename E::value_t *out, size_t len, const E &e) {
+    _vx_assign_lanes<typename VxSimd<typename E::value_t, 32>::type>(out, len, e);
+}
+
+template <typename E>
+__attribute__((target("avx512f")))
+void _vx_assign_avx512(typename E::value_t *out, size_t len, const E &e) {
+    _vx_assign_lanes<typename VxSimd<typename E::value_t, 64>::type>(out, len, e);
+}
+
+template <typename E>
+__attribute__((target("sse2")))
+typename E::value_t _vx_sum_sse(size_t len, const E &e) {
+    return _vx_sum_lanes<typename VxSimd<typename E::value_t, 16>::type>(len, e);
+}
+
+template <typename E>
+__attribute__((target("avx2")))
+typename E::value_t _vx_sum_avx2(size_t len, const E &e) {
+    return _vx_sum_lanes<typename VxSimd<typename E::value_t, 32>::type>(len, e);
+}
+
+template <typename E>
+__attribute__((target("avx512f")))
+typename E::value_t _vx_sum_avx512(size_t len, const E &e) {
+    return _vx_sum_lanes<typename VxSimd<typename E::value_t, 64>::type>(len, e);
+}
+#endif /* VX_X86 */
+
+/* out[i] = e[i] for i < len, in one pass. `out` may be one of the inputs */
+template <typename E, typename = std::enable_if_t<vx_is_expr<E>::value>>
+void vx_assign(typename E::value_t *out, size_t len, const E &e) {
+    switch (vx_isa()) {
+#if VX_X86
+    case VxIsa::AVX512:
+        return _vx_assign_avx512(out, len, e);
+    case VxIsa::AVX2:
+        return _vx_assign_avx2(out, len, e);
+    case VxIsa::SSE:
+        return _vx_assign_sse(out, len, e);
+#endif
+    default:
+        return _vx_assign_scalar(out, len, e);
+    }
+}
+
+/* Sum of e[i] for i < len, in one pass */
+template <typename E, typename = std::enable_if_t<vx_is_expr<E>::value>>
+typename E::value_t vx_sum(size_t len, const E &e) {
+    switch (vx_isa()) {
+#if VX_X86
+    case VxIsa::AVX512:
+        return _vx_sum_avx512(len, e);
+    case VxIsa::AVX2:
+        return _vx_sum_avx2(len, e);
+    case VxIsa::SSE:
+        return _vx_sum_sse(len, e);
+#endif
+    default:
+        return _vx_sum_scalar(len, e);
+    }
+}
+
+/* As vx_assign(), with non-temporal stores that bypass the caches. For a
+ * result too large to stay cached this saves reading every line of `out` in
+ * before it is overwritten. Streaming stores exist for float and double, other
+ * element types fall back to vx_assign() */
+template <typename E, typename = std::enable_if_t<vx_is_expr<E>::value>>
+void vx_assign_stream(typename E::value_t *out, size_t len, const E &e) {
+    typedef typename E::value_t T;
+#if VX_X86
+    if constexpr (std::is_same<T, float>::value || std::is_same<T, double>::value) {
+        typedef typename VxSimd<T, 16>::type V;
+        constexpr size_t W = sizeof(V) / sizeof(T);
+
+        /* Streaming stores need a 16-byte aligned destination */
+        size_t i = 0;
+        for (; (i < len) && ((uintptr_t)(out + i) % sizeof(V)); i++) {
+            out[i] = e[i];
+        }
+        for (; i + W <= len; i += W) {
+            V v;
+            e.load(i, v);
+            if constexpr (std::is_same<T, float>::value) {
+                _mm_stream_ps(out + i, (__m128)v);
+            } else {
+                _mm_stream_pd(out + i, (__m128d)v);
+            }
+        }
+        for (; i < len; i++) {
+            out[i] = e[i];
+        }
+
+        /* Streaming stores are weakly ordered, make them visible before
+         * whatever signals completion */
+        _mm_sfence();
+        return;
+    }
+#endif
+    vx_assign(out, len, e);
+}
+
+/*
+ * SYCL evaluation, the vectors of `e` are USM device pointers
+ */
+
+/* One kernel computing out[i] = e[i] for i < len */
+template <typename E, typename = std::enable_if_t<vx_is_expr<E>::value>>
+sycl::event vx_assign(sycl::queue &q, typename E::value_t *out, size_t len, const E &e,
+                      const std::vector<sycl::event> &deps = {}) {
+    return q.submit([&](sycl::handler &cgh) {
+        cgh.depends_on(deps);
+        cgh.parallel_for(sycl::range<1>(len), [=](sycl::id<1> idx) {
+            auto i = idx[0];
+            out[i] = e[i];
+        });
+    });
+}
+
+/* One kernel writing the sum of e[i] for i < len to the device pointer `sum` */
+template <typename E, typename = std::enable_if_t<vx_is_expr<E>::value>>
+sycl::event vx_sum(sycl::queue &q, typename E::value_t *sum, size_t len, const E &e,
+                   const std::vector<sycl::event> &deps = {}) {
+    typedef typename E::value_t T;
+    return q.submit([&](sycl::handler &cgh) {
+        cgh.depends_on(deps);
+        auto red = sycl::reduction(sum, sycl::plus<T>(),
+                                   sycl::property::reduction::initialize_to_identity{});
+        cgh.parallel_for(sycl::range<1>(len), red, [=](sycl::id<1> idx, auto &acc) {
+            acc += e[idx[0]];
+        });
+    });
+}
+
+#endif